@@ -0,0 +1,75 @@
+#include "BoundingVolume.h"
+#include <cmath>
+
+BoundingVolume computeBounds(const Vertex* vertices, size_t count)
+{
+	BoundingVolume bounds;
+	bounds.boxMin = bounds.boxMax = count > 0 ? vertices[0].position : glm::vec3(0.0f);
+	for (size_t i = 1; i < count; i++)
+	{
+		bounds.boxMin = glm::min(bounds.boxMin, vertices[i].position);
+		bounds.boxMax = glm::max(bounds.boxMax, vertices[i].position);
+	}
+	bounds.center = (bounds.boxMin + bounds.boxMax) * 0.5f;
+
+	// Farthest vertex from the box centre, which is tighter than the half diagonal
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 offset = vertices[i].position - bounds.center;
+		radiusSquared = fmaxf(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.radius = sqrtf(radiusSquared);
+	return bounds;
+}
+
+glm::vec4 transformSphere(const BoundingVolume& bounds, const glm::mat4& transform)
+{
+	float scale = fmaxf(glm::length(glm::vec3(transform[0])), fmaxf(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+	return glm::vec4(glm::vec3(transform * glm::vec4(bounds.center, 1.0f)), bounds.radius * scale);
+}
+
+BoundingVolume transformBounds(const BoundingVolume& bounds, const glm::mat4& transform)
+{
+	BoundingVolume result;
+	result.boxMin = result.boxMax = glm::vec3(transform[3]);
+	for (int column = 0; column < 3; column++)
+	{
+		glm::vec3 axis(transform[column]);
+		glm::vec3 a = axis * bounds.boxMin[column];
+		glm::vec3 b = axis * bounds.boxMax[column];
+		result.boxMin += glm::min(a, b);
+		result.boxMax += glm::max(a, b);
+	}
+	glm::vec4 sphere = transformSphere(bounds, transform);
+	result.center = glm::vec3(sphere);
+	result.radius = sphere.w;
+	return result;
+}
+
+BoundingVolume mergeBounds(const BoundingVolume& a, const BoundingVolume& b)
+{
+	BoundingVolume result;
+	result.boxMin = glm::min(a.boxMin, b.boxMin);
+	result.boxMax = glm::max(a.boxMax, b.boxMax);
+
+	// Smallest sphere around both, unless one already holds the other
+	glm::vec3 offset = b.center - a.center;
+	float distance = glm::length(offset);
+	if (distance + b.radius <= a.radius)
+	{
+		result.center = a.center;
+		result.radius = a.radius;
+	}
+	else if (distance + a.radius <= b.radius)
+	{
+		result.center = b.center;
+		result.radius = b.radius;
+	}
+	else
+	{
+		result.radius = (distance + a.radius + b.radius) * 0.5f;
+		result.center = a.center + offset * ((result.radius - a.radius) / distance);
+	}
+	return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "Vertex.h"
+
+// Axis-aligned box and bounding sphere of a mesh; the sphere is centred on the box
+struct BoundingVolume
+{
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+	glm::vec3 center;
+	float radius;
+};
+
+BoundingVolume computeBounds(const Vertex* vertices, size_t count);
+
+// Sphere (xyz centre, w radius) around the volume after an affine transform; the radius grows
+// by the transform's largest axis scale
+glm::vec4 transformSphere(const BoundingVolume& bounds, const glm::mat4& transform);
+
+// Box stays axis-aligned around the transformed box (Arvo), sphere as in transformSphere
+BoundingVolume transformBounds(const BoundingVolume& bounds, const glm::mat4& transform);
+BoundingVolume mergeBounds(const BoundingVolume& a, const BoundingVolume& b);
@@ -0,0 +1,156 @@
+#include "ClusteredLights.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	GLuint clampCell(float value, GLuint count)
+	{
+		if (value < 0.0f)
+			return 0;
+		GLuint cell = (GLuint)value;
+		return cell < count ? cell : count - 1;
+	}
+}
+
+void LightClusters::create()
+{
+	glGenBuffers(1, &lightBuffer);
+	glGenBuffers(1, &clusterBuffer);
+	glGenBuffers(1, &indexBuffer);
+
+	// The grid never changes size, so it is allocated once and rewritten in place
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(glm::uvec2), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_BINDING, clusterBuffer);
+	clusters.resize(CLUSTER_COUNT);
+}
+
+void LightClusters::destroy()
+{
+	glDeleteBuffers(1, &lightBuffer);
+	glDeleteBuffers(1, &clusterBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	lightBuffer = clusterBuffer = indexBuffer = 0;
+}
+
+// Finds the range of froxels covered by a light's view-space bounding box
+bool LightClusters::computeBounds(const PointLight& light, GLuint index, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, LightBounds& out) const
+{
+	glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+	float radius = light.radius;
+
+	// View space looks down -z, so depth is the negated z coordinate
+	float minDepth = -(center.z + radius);
+	float maxDepth = -(center.z - radius);
+	if (maxDepth < nearPlane || minDepth > farPlane)
+		return false;
+	minDepth = std::max(minDepth, nearPlane);
+	maxDepth = std::min(maxDepth, farPlane);
+
+	// Project the box corners, pulled in front of the near plane, to get a conservative screen rectangle
+	glm::vec2 ndcMin(1.0f);
+	glm::vec2 ndcMax(-1.0f);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 p = center + glm::vec3(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius);
+		p.z = std::min(p.z, -nearPlane);
+		glm::vec4 clip = projection * glm::vec4(p, 1.0f);
+		glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+		ndcMin.x = std::min(ndcMin.x, ndc.x);
+		ndcMin.y = std::min(ndcMin.y, ndc.y);
+		ndcMax.x = std::max(ndcMax.x, ndc.x);
+		ndcMax.y = std::max(ndcMax.y, ndc.y);
+	}
+	if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+		return false;
+
+	out.light = index;
+	out.minX = clampCell((ndcMin.x * 0.5f + 0.5f) * GRID_X, GRID_X);
+	out.maxX = clampCell((ndcMax.x * 0.5f + 0.5f) * GRID_X, GRID_X);
+	out.minY = clampCell((ndcMin.y * 0.5f + 0.5f) * GRID_Y, GRID_Y);
+	out.maxY = clampCell((ndcMax.y * 0.5f + 0.5f) * GRID_Y, GRID_Y);
+	out.minZ = clampCell(std::log(minDepth) * sliceScale - sliceBias, GRID_Z);
+	out.maxZ = clampCell(std::log(maxDepth) * sliceScale - sliceBias, GRID_Z);
+	return true;
+}
+
+void LightClusters::build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+	// Exponential depth slices keep froxels roughly cube shaped across the whole frustum
+	float logRange = std::log(farPlane / nearPlane);
+	sliceScale = GRID_Z / logRange;
+	sliceBias = GRID_Z * std::log(nearPlane) / logRange;
+
+	indices.clear();
+	bounds.clear();
+	for (size_t i = 0; i < clusters.size(); i++)
+		clusters[i] = glm::uvec2(0);
+
+	// Pass 1: unbounded lights go straight into the list, bounded ones count their froxels
+	for (GLuint i = 0; i < (GLuint)lights.size(); i++)
+	{
+		if (lights[i].radius <= 0.0f)
+		{
+			indices.push_back(i);
+			continue;
+		}
+
+		LightBounds b;
+		if (!computeBounds(lights[i], i, view, projection, nearPlane, farPlane, b))
+			continue;
+		bounds.push_back(b);
+		for (GLuint z = b.minZ; z <= b.maxZ; z++)
+			for (GLuint y = b.minY; y <= b.maxY; y++)
+				for (GLuint x = b.minX; x <= b.maxX; x++)
+					clusters[x + GRID_X * (y + GRID_Y * z)].y++;
+	}
+	globalCount = (GLuint)indices.size();
+
+	// Prefix sum turns counts into offsets, then counts are rebuilt while scattering
+	GLuint offset = globalCount;
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		clusters[c].x = offset;
+		offset += clusters[c].y;
+		clusters[c].y = 0;
+	}
+	indices.resize(offset);
+
+	// Pass 2: scatter light indices into each covered froxel's range
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		const LightBounds& b = bounds[i];
+		for (GLuint z = b.minZ; z <= b.maxZ; z++)
+			for (GLuint y = b.minY; y <= b.maxY; y++)
+				for (GLuint x = b.minX; x <= b.maxX; x++)
+				{
+					glm::uvec2& cluster = clusters[x + GRID_X * (y + GRID_Y * z)];
+					indices[cluster.x + cluster.y++] = b.light;
+				}
+	}
+}
+
+// Orphans and refills the light and index lists, which change size every frame
+void LightClusters::upload(const std::vector<PointLight>& lights) const
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(lights.size(), 1) * sizeof(PointLight), NULL, GL_DYNAMIC_DRAW);
+	if (!lights.empty())
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lights.size() * sizeof(PointLight), lights.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(indices.size(), 1) * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	if (!indices.empty())
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, clusters.size() * sizeof(glm::uvec2), clusters.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// glBufferData may hand back new storage, so the bindings are refreshed every upload
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_LIST_BINDING, lightBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BINDING, indexBuffer);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Shader storage binding points used by the clustered lighting path
+enum LightStorageBinding
+{
+	LIGHT_LIST_BINDING = 2,
+	LIGHT_CLUSTER_BINDING = 3,
+	LIGHT_INDEX_BINDING = 4
+};
+
+// std430 mirror of the shader's PointLight. A radius of zero marks an unbounded light
+// (the key and fill lights) that reaches every fragment instead of being binned.
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float ambientStrength;
+};
+
+// Bins point lights into view-space froxels each frame so the fragment shader only
+// loops over the lights whose bounding sphere touches its cluster.
+class LightClusters
+{
+public:
+	static const GLuint GRID_X = 16;
+	static const GLuint GRID_Y = 9;
+	static const GLuint GRID_Z = 24;
+	static const GLuint CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+	LightClusters() : lightBuffer(0), clusterBuffer(0), indexBuffer(0), globalCount(0), sliceScale(0.0f), sliceBias(0.0f) {}
+
+	void create();
+	void destroy();
+
+	// Rebuilds the cluster grid for this frame's camera. Unbounded lights are stored at
+	// the front of the index list and counted by globalLightCount().
+	void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+	void upload(const std::vector<PointLight>& lights) const;
+
+	GLuint globalLightCount() const { return globalCount; }
+	GLuint binnedReferences() const { return (GLuint)indices.size() - globalCount; }
+	// log(depth) * scale - bias gives the depth slice of a view-space depth
+	float depthSliceScale() const { return sliceScale; }
+	float depthSliceBias() const { return sliceBias; }
+
+private:
+	struct LightBounds
+	{
+		GLuint light;
+		GLuint minX, maxX, minY, maxY, minZ, maxZ;
+	};
+
+	bool computeBounds(const PointLight& light, GLuint index, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, LightBounds& bounds) const;
+
+	GLuint lightBuffer;
+	GLuint clusterBuffer;
+	GLuint indexBuffer;
+	GLuint globalCount;
+	float sliceScale;
+	float sliceBias;
+	std::vector<glm::uvec2> clusters;  // (first index, light count) per froxel
+	std::vector<GLuint> indices;
+	std::vector<LightBounds> bounds;
+};
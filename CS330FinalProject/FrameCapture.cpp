@@ -0,0 +1,181 @@
+#include "FrameCapture.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+FrameCapture::FrameCapture() :
+	encoders(FRAME_CAPTURE_ENCODERS + 1), nextSlot(0), frameWidth(0), frameHeight(0),
+	stalls(0), captures(0), captureSeconds(0.0), written(0), failed(0)
+{
+	for (int i = 0; i < FRAME_CAPTURE_RING_SIZE; i++)
+	{
+		Slot slot = { 0, 0, 0, 0, false, false };
+		slots[i] = slot;
+	}
+}
+
+FrameCapture::~FrameCapture()
+{
+	encoders.wait();
+}
+
+void FrameCapture::create(const char* outputPrefix)
+{
+	prefix = outputPrefix;
+}
+
+void FrameCapture::destroy()
+{
+	finish();
+	release();
+}
+
+void FrameCapture::allocate(int width, int height)
+{
+	frameWidth = width;
+	frameHeight = height;
+	GLsizeiptr bytes = (GLsizeiptr)width * height * 3;
+	for (int i = 0; i < FRAME_CAPTURE_RING_SIZE; i++)
+	{
+		Slot& slot = slots[i];
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		// Coherent, so a signaled fence is all the encoders need before reading
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, NULL, flags);
+		slot.pixels = (unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	nextSlot = 0;
+}
+
+void FrameCapture::release()
+{
+	for (int i = 0; i < FRAME_CAPTURE_RING_SIZE; i++)
+	{
+		Slot& slot = slots[i];
+		if (!slot.buffer)
+			continue;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glDeleteBuffers(1, &slot.buffer);
+		slot.buffer = 0;
+		slot.pixels = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	frameWidth = frameHeight = 0;
+}
+
+void FrameCapture::capture(int frameIndex, int width, int height)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (width != frameWidth || height != frameHeight)
+	{
+		finish();
+		release();
+		allocate(width, height);
+	}
+
+	collect(false);
+
+	// The ring is full: wait for the oldest readback, then for its file
+	Slot& slot = slots[nextSlot];
+	if (slot.pending)
+	{
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		collect(false);
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (slot.encoding || slot.pending)
+			stalls++;
+		slotEncoded.wait(lock, [&slot] { return !slot.encoding; });
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frameIndex;
+	slot.pending = true;
+	nextSlot = (nextSlot + 1) % FRAME_CAPTURE_RING_SIZE;
+
+	captures++;
+	captureSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrameCapture::collect(bool wait)
+{
+	// Readbacks complete in order, so the scan stops at the first one still in flight
+	for (int i = 0; i < FRAME_CAPTURE_RING_SIZE; i++)
+	{
+		Slot& slot = slots[(nextSlot + i) % FRAME_CAPTURE_RING_SIZE];
+		if (!slot.pending)
+			continue;
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		slot.pending = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot.encoding = true;
+		}
+		Slot* encoded = &slot;
+		encoders.submit([this, encoded] { encode(*encoded); });
+	}
+}
+
+void FrameCapture::encode(Slot& slot)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s_%04d.tga", prefix.c_str(), slot.frame);
+	bool ok = writeTGA(path, frameWidth, frameHeight, slot.pixels);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	slot.encoding = false;
+	if (ok)
+		written++;
+	else
+		failed++;
+	slotEncoded.notify_all();
+}
+
+void FrameCapture::finish()
+{
+	collect(true);
+	encoders.wait();
+}
+
+int FrameCapture::writtenFrames() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return written;
+}
+
+int FrameCapture::failedFrames() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return failed;
+}
+
+bool writeTGA(const char* path, int width, int height, const unsigned char* bgr)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+	// Image type 2 (uncompressed true color), 24 bits per pixel, origin at the bottom left
+	unsigned char header[18] = {};
+	header[2] = 2;
+	header[12] = (unsigned char)(width & 0xFF);
+	header[13] = (unsigned char)(width >> 8);
+	header[14] = (unsigned char)(height & 0xFF);
+	header[15] = (unsigned char)(height >> 8);
+	header[16] = 24;
+	out.write((const char*)header, sizeof(header));
+	out.write((const char*)bgr, (std::streamsize)width * height * 3);
+	out.close();
+	return !out.fail();
+}
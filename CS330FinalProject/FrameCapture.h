@@ -0,0 +1,75 @@
+#pragma once
+#include <GL/glew.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include "ThreadPool.h"
+
+// Readbacks in flight before capture() has to wait for the oldest one
+const int FRAME_CAPTURE_RING_SIZE = 3;
+// Encoder threads, kept apart from the shared pool so parallelFor never queues behind a write
+const unsigned FRAME_CAPTURE_ENCODERS = 2;
+
+// Writes every captured frame to <prefix>_NNNN.tga without stalling the render thread.
+// glReadPixels goes into the next pixel buffer of a persistently mapped ring, and a fence marks
+// when the copy is done. Finished buffers are handed to encoder threads, which write them
+// straight from the mapping: a bottom-up BGR readback is already the layout of an uncompressed
+// TGA. A buffer is only reused after its file is written.
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	void create(const char* outputPrefix);
+	// Waits for every pending frame to be written, then frees the ring
+	void destroy();
+
+	// Queues a readback of the current read framebuffer; the ring is resized to match
+	void capture(int frameIndex, int width, int height);
+	// Blocks until every queued frame is on disk
+	void finish();
+
+	int writtenFrames() const;
+	int failedFrames() const;
+	int stallCount() const { return stalls; }
+	// Average time capture() spent on the render thread
+	double captureMilliseconds() const { return captures > 0 ? captureSeconds * 1000.0 / captures : 0.0; }
+
+private:
+	struct Slot
+	{
+		GLuint buffer;
+		unsigned char* pixels;  // Persistent, coherent read mapping of buffer
+		GLsync fence;
+		int frame;
+		bool pending;           // Readback issued, not yet handed to an encoder
+		bool encoding;          // Guarded by mutex
+	};
+
+	void allocate(int width, int height);
+	void release();
+	// Hands finished readbacks to the encoders, oldest first; waits for them when wait is set
+	void collect(bool wait);
+	void encode(Slot& slot);
+
+	ThreadPool encoders;
+	std::string prefix;
+	Slot slots[FRAME_CAPTURE_RING_SIZE];
+	int nextSlot;
+	int frameWidth;
+	int frameHeight;
+	int stalls;
+	int captures;
+	double captureSeconds;
+
+	mutable std::mutex mutex;
+	std::condition_variable slotEncoded;
+	int written;
+	int failed;
+};
+
+// Uncompressed 24-bit TGA of bottom-up BGR rows, in one write
+bool writeTGA(const char* path, int width, int height, const unsigned char* bgr);
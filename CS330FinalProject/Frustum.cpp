@@ -0,0 +1,73 @@
+#include "Frustum.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+	Frustum frustum;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		frustum.planes[axis * 2] = rows[3] + rows[axis];
+		frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+	for (int p = 0; p < 6; p++)
+		frustum.planes[p] /= glm::length(glm::vec3(frustum.planes[p]));
+	return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		if (glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+void cullSpheres(const Frustum& frustum, const glm::vec4* spheres, size_t count, unsigned char* visible)
+{
+	size_t i = 0;
+#ifdef FRUSTUM_SSE
+	// Four spheres are transposed into x, y, z and radius lanes and tested against one plane at a time
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres[i][0]);
+		__m128 y = _mm_loadu_ps(&spheres[i + 1][0]);
+		__m128 z = _mm_loadu_ps(&spheres[i + 2][0]);
+		__m128 r = _mm_loadu_ps(&spheres[i + 3][0]);
+		_MM_TRANSPOSE4_PS(x, y, z, r);
+		__m128 negativeRadius = _mm_sub_ps(zero, r);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+			visible[i + lane] = (unsigned char)((mask >> lane) & 1);
+	}
+#endif
+	for (; i < count; i++)
+		visible[i] = sphereInFrustum(frustum, glm::vec3(spheres[i]), spheres[i].w) ? 1 : 0;
+}
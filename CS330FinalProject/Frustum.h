@@ -0,0 +1,21 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Left, right, bottom, top, near and far clip planes with inward normals, normalized so that
+// dot(plane.xyz, p) + plane.w is the signed distance of p
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Planes of the space that the matrix maps to clip space (Gribb and Hartmann). Works for ortho
+// and perspective projections alike: projection * view gives world space planes, an MVP gives
+// model space planes.
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius);
+
+// Tests spheres (xyz centre, w radius) four at a time; visible[i] becomes 1 when sphere i
+// touches the frustum and 0 otherwise
+void cullSpheres(const Frustum& frustum, const glm::vec4* spheres, size_t count, unsigned char* visible);
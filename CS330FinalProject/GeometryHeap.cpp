@@ -0,0 +1,133 @@
+#include "GeometryHeap.h"
+#include <vector>
+
+RangeAllocator::RangeAllocator(GLuint capacity)
+{
+	reset(capacity);
+}
+
+void RangeAllocator::reset(GLuint capacity)
+{
+	freeRanges.clear();
+	if (capacity > 0)
+		freeRanges[0] = capacity;
+	total = capacity;
+	available = capacity;
+}
+
+bool RangeAllocator::allocate(GLuint count, GLuint& offset)
+{
+	for (std::map<GLuint, GLuint>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		if (it->second < count)
+			continue;
+		offset = it->first;
+		GLuint remaining = it->second - count;
+		freeRanges.erase(it);
+		if (remaining > 0)
+			freeRanges[offset + count] = remaining;
+		available -= count;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::free(GLuint offset, GLuint count)
+{
+	if (count == 0)
+		return;
+	available += count;
+	std::map<GLuint, GLuint>::iterator next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && offset + count == next->first)
+	{
+		count += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin())
+	{
+		std::map<GLuint, GLuint>::iterator previous = next;
+		--previous;
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += count;
+			return;
+		}
+	}
+	freeRanges[offset] = count;
+}
+
+void GeometryHeap::create(GLuint vertexCapacity, GLuint indexCapacity, GLenum indexType)
+{
+	heapIndexType = indexType;
+	vertexRanges.reset(vertexCapacity);
+	indexRanges.reset(indexCapacity);
+
+	glGenVertexArrays(1, &vertexArray);
+	glGenBuffers(1, &vertexBufferId);
+	glGenBuffers(1, &indexBufferId);
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCapacity * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+	setupPackedVertexAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCapacity * indexSize(), NULL, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+}
+
+void GeometryHeap::destroy()
+{
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteBuffers(1, &vertexBufferId);
+	glDeleteBuffers(1, &indexBufferId);
+	vertexArray = vertexBufferId = indexBufferId = 0;
+	vertexRanges.reset(0);
+	indexRanges.reset(0);
+}
+
+bool GeometryHeap::upload(const PackedVertex* vertices, const ShapeData& shape, GeometryAllocation& allocation)
+{
+	if (heapIndexType == GL_UNSIGNED_SHORT && shape.numVertices > 65536)
+		return false;
+	GLuint firstVertex, firstIndex;
+	if (!vertexRanges.allocate(shape.numVertices, firstVertex))
+		return false;
+	if (!indexRanges.allocate(shape.numIndices, firstIndex))
+	{
+		vertexRanges.free(firstVertex, shape.numVertices);
+		return false;
+	}
+	allocation.firstIndex = firstIndex;
+	allocation.indexCount = shape.numIndices;
+	allocation.baseVertex = (GLint)firstVertex;
+	allocation.vertexCount = shape.numVertices;
+
+	// Written through the copy target so the bound VAO's element buffer is left alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferId);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)firstVertex * sizeof(PackedVertex), (GLsizeiptr)shape.numVertices * sizeof(PackedVertex), vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBufferId);
+	GLintptr indexOffset = (GLintptr)firstIndex * indexSize();
+	if (shape.indexType == heapIndexType)
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, shape.indexBufferSize(), shape.indices);
+	else if (heapIndexType == GL_UNSIGNED_INT)
+	{
+		std::vector<GLuint> converted(shape.numIndices);
+		for (GLuint i = 0; i < shape.numIndices; i++)
+			converted[i] = shape.index(i);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, converted.size() * sizeof(GLuint), converted.data());
+	}
+	else
+	{
+		std::vector<GLushort> converted(shape.numIndices);
+		for (GLuint i = 0; i < shape.numIndices; i++)
+			converted[i] = (GLushort)shape.index(i);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, converted.size() * sizeof(GLushort), converted.data());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return true;
+}
+
+void GeometryHeap::release(const GeometryAllocation& allocation)
+{
+	vertexRanges.free((GLuint)allocation.baseVertex, allocation.vertexCount);
+	indexRanges.free(allocation.firstIndex, allocation.indexCount);
+}
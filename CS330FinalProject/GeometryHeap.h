@@ -0,0 +1,78 @@
+#pragma once
+#include <GL/glew.h>
+#include <map>
+#include "PackedVertex.h"
+#include "ShapeData.h"
+
+// Capacity of the shared geometry buffers: 4 MB of packed vertices, 2 MB of 16-bit or 4 MB of 32-bit indices
+const GLuint GEOMETRY_HEAP_VERTICES = 1 << 18;
+const GLuint GEOMETRY_HEAP_INDICES = 1 << 20;
+
+// First-fit free list over [0, capacity); freed ranges merge with free neighbours
+class RangeAllocator
+{
+public:
+	explicit RangeAllocator(GLuint capacity = 0);
+
+	void reset(GLuint capacity);
+	bool allocate(GLuint count, GLuint& offset);
+	void free(GLuint offset, GLuint count);
+
+	GLuint capacity() const { return total; }
+	GLuint freeCount() const { return available; }
+
+private:
+	std::map<GLuint, GLuint> freeRanges; // offset -> count
+	GLuint total;
+	GLuint available;
+};
+
+// Where a mesh lives in the heap. Its indices stay local to the mesh, so draws pass
+// baseVertex along with the index range.
+struct GeometryAllocation
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+	GLuint vertexCount;
+};
+
+// Every static mesh in one vertex buffer of packed vertices and one index buffer, set up
+// once in a single VAO, so all of them draw without rebinding anything.
+class GeometryHeap
+{
+public:
+	GeometryHeap() : vertexArray(0), vertexBufferId(0), indexBufferId(0), heapIndexType(GL_UNSIGNED_SHORT) {}
+
+	// indexType applies to the whole heap; 16-bit indices limit each mesh to 65536 vertices
+	void create(GLuint vertexCapacity, GLuint indexCapacity, GLenum indexType);
+	void destroy();
+
+	// Sub-allocates room for the mesh and uploads its packed vertices and its indices,
+	// converted to the heap's index type. False when the heap is full or the mesh has more
+	// vertices than the index type can address.
+	bool upload(const PackedVertex* vertices, const ShapeData& shape, GeometryAllocation& allocation);
+	void release(const GeometryAllocation& allocation);
+
+	GLuint vao() const { return vertexArray; }
+	// For VAOs that pair the heap's vertices with an element buffer of their own
+	GLuint vertexBuffer() const { return vertexBufferId; }
+	GLenum indexType() const { return heapIndexType; }
+	GLsizeiptr indexSize() const { return heapIndexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort); }
+	// The indices argument of glDrawElements* for a range of the allocation's indices
+	const void* indexOffset(const GeometryAllocation& allocation, GLuint firstIndex = 0) const
+	{
+		return (const void*)((allocation.firstIndex + firstIndex) * indexSize());
+	}
+
+	GLuint usedVertices() const { return vertexRanges.capacity() - vertexRanges.freeCount(); }
+	GLuint usedIndices() const { return indexRanges.capacity() - indexRanges.freeCount(); }
+
+private:
+	GLuint vertexArray;
+	GLuint vertexBufferId;
+	GLuint indexBufferId;
+	GLenum heapIndexType;
+	RangeAllocator vertexRanges;
+	RangeAllocator indexRanges;
+};
@@ -0,0 +1,70 @@
+#include "IndirectDraws.h"
+
+void IndirectDrawBuffer::create()
+{
+	glGenBuffers(1, &commandBuffer);
+}
+
+void IndirectDrawBuffer::destroy()
+{
+	glDeleteBuffers(1, &commandBuffer);
+	commandBuffer = 0;
+	commandCapacity = 0;
+}
+
+void IndirectDrawBuffer::clear()
+{
+	commands.clear();
+	runs.clear();
+}
+
+GLuint IndirectDrawBuffer::beginRun()
+{
+	Run run = { (GLuint)commands.size(), 0 };
+	runs.push_back(run);
+	return (GLuint)runs.size() - 1;
+}
+
+void IndirectDrawBuffer::add(const GeometryAllocation& mesh, GLuint firstIndex, GLuint indexCount, GLuint instanceCount, GLuint baseInstance)
+{
+	if (indexCount == 0 || instanceCount == 0)
+		return;
+	DrawElementsIndirectCommand command = { indexCount, instanceCount, mesh.firstIndex + firstIndex, mesh.baseVertex, baseInstance };
+	commands.push_back(command);
+	runs.back().commandCount++;
+}
+
+// Every run's commands in one upload
+void IndirectDrawBuffer::upload()
+{
+	GLsizeiptr bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+	if (bytes > commandCapacity)
+		commandCapacity = bytes * 2;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	// Orphan the old storage so the upload never waits on last frame's draws
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity, NULL, GL_STREAM_DRAW);
+	if (bytes > 0)
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+}
+
+void IndirectDrawBuffer::draw(GLuint run, GLenum indexType) const
+{
+	const Run& commandRun = runs[run];
+	if (commandRun.commandCount == 0)
+		return;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void*)(commandRun.firstCommand * sizeof(DrawElementsIndirectCommand)),
+		(GLsizei)commandRun.commandCount, 0);
+}
+
+void IndirectDrawBuffer::drawDirect(GLuint run, GLenum indexType) const
+{
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	const Run& commandRun = runs[run];
+	for (GLuint i = 0; i < commandRun.commandCount; i++)
+	{
+		const DrawElementsIndirectCommand& command = commands[commandRun.firstCommand + i];
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, indexType,
+			(const void*)(command.firstIndex * indexSize), command.instanceCount, command.baseVertex, command.baseInstance);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include "GeometryHeap.h"
+
+// Record layout glMultiDrawElementsIndirect reads from the draw indirect buffer
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Draw commands of a frame that read the geometry heap, grouped into one run per program.
+// Each command's base instance selects its ObjectTransform slice through the instance index
+// attribute, so a whole run goes out as one glMultiDrawElementsIndirect with nothing bound
+// or uploaded in between, whatever the number of objects.
+class IndirectDrawBuffer
+{
+public:
+	IndirectDrawBuffer() : commandBuffer(0), commandCapacity(0) {}
+
+	void create();
+	void destroy();
+
+	void clear();
+	// Starts the run that following add() calls append to; returns its handle for draw()
+	GLuint beginRun();
+	// firstIndex and indexCount are relative to the mesh's own indices
+	void add(const GeometryAllocation& mesh, GLuint firstIndex, GLuint indexCount, GLuint instanceCount, GLuint baseInstance);
+	void upload();
+
+	// Both expect the heap's VAO and the run's program to be bound
+	void draw(GLuint run, GLenum indexType) const;
+	// One glDrawElementsInstancedBaseVertexBaseInstance per command, to compare against
+	void drawDirect(GLuint run, GLenum indexType) const;
+
+	GLuint commandCount() const { return (GLuint)commands.size(); }
+	GLuint runCommandCount(GLuint run) const { return runs[run].commandCount; }
+	GLuint runCount() const { return (GLuint)runs.size(); }
+
+private:
+	struct Run
+	{
+		GLuint firstCommand;
+		GLuint commandCount;
+	};
+
+	GLuint commandBuffer;
+	GLsizeiptr commandCapacity;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<Run> runs;
+};
@@ -0,0 +1,81 @@
+#include "InstanceBuffer.h"
+
+void InstanceBuffer::create()
+{
+	glGenBuffers(1, &transformBuffer);
+	glGenBuffers(1, &indexBuffer);
+}
+
+void InstanceBuffer::destroy()
+{
+	glDeleteBuffers(1, &transformBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	transformBuffer = indexBuffer = 0;
+	transformCapacity = 0;
+	indexCapacity = 0;
+}
+
+// Points the instance index attribute of a VAO at this buffer and advances it once per instance
+void InstanceBuffer::attach(GLuint vao) const
+{
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+	glEnableVertexAttribArray(INSTANCE_INDEX_ATTRIBUTE);
+	glVertexAttribIPointer(INSTANCE_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+	glVertexAttribDivisor(INSTANCE_INDEX_ATTRIBUTE, 1);
+	glBindVertexArray(0);
+}
+
+void InstanceBuffer::clear()
+{
+	models.clear();
+	positionDecodes.clear();
+	colors.clear();
+}
+
+// Returns the instance index to pass as the base instance of a draw
+GLuint InstanceBuffer::add(const glm::mat4& model, const glm::vec4& color)
+{
+	return add(model, glm::mat4(1.0f), color);
+}
+
+GLuint InstanceBuffer::add(const glm::mat4& model, const glm::mat4& positionDecode, const glm::vec4& color)
+{
+	models.push_back(model);
+	positionDecodes.push_back(positionDecode);
+	colors.push_back(color);
+	return (GLuint)models.size() - 1;
+}
+
+// Computes every transform record of the frame in one batch and sends them in one upload
+void InstanceBuffer::upload(const glm::mat4& viewProjection)
+{
+	size_t count = models.size();
+	records.resize(count);
+	computeObjectTransforms(models.data(), positionDecodes.data(), count, viewProjection, records.data());
+	for (size_t i = 0; i < count; i++)
+		records[i].color = colors[i];
+
+	// The index stream only changes when the instance count outgrows it
+	if (count > indexCapacity)
+	{
+		indexCapacity = (GLuint)count * 2;
+		std::vector<GLuint> sequence(indexCapacity);
+		for (GLuint i = 0; i < indexCapacity; i++)
+			sequence[i] = i;
+		glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, indexCapacity * sizeof(GLuint), sequence.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	GLsizeiptr bytes = count * sizeof(ObjectTransform);
+	if (bytes > transformCapacity)
+		transformCapacity = bytes * 2;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformBuffer);
+	// Orphan the old storage so the upload never waits on last frame's draws
+	glBufferData(GL_SHADER_STORAGE_BUFFER, transformCapacity, NULL, GL_STREAM_DRAW);
+	if (bytes > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, records.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_TRANSFORM_BINDING, transformBuffer);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "TransformBatch.h"
+
+// Vertex attribute location of the per-instance object index
+enum InstanceAttribute
+{
+	INSTANCE_INDEX_ATTRIBUTE = 3
+};
+
+// Shader storage binding point of the ObjectTransforms array
+enum InstanceStorageBinding
+{
+	OBJECT_TRANSFORM_BINDING = 5
+};
+
+// Collects every instance drawn in a frame. Model, normal matrix and MVP are computed
+// once per object on the CPU and stored in one shader storage buffer. Draws select their
+// slice with the base instance of glDrawElementsInstancedBaseInstance, which offsets the
+// per-instance index attribute so the shader can find its ObjectTransform record.
+class InstanceBuffer
+{
+public:
+	InstanceBuffer() : transformBuffer(0), indexBuffer(0), transformCapacity(0), indexCapacity(0) {}
+
+	void create();
+	void destroy();
+	void attach(GLuint vao) const;
+
+	void clear();
+	GLuint add(const glm::mat4& model, const glm::vec4& color = glm::vec4(1.0f));
+	// For meshes with quantized positions; positionDecode maps them back to mesh space
+	GLuint add(const glm::mat4& model, const glm::mat4& positionDecode, const glm::vec4& color = glm::vec4(1.0f));
+	void upload(const glm::mat4& viewProjection);
+
+	GLuint size() const { return (GLuint)models.size(); }
+
+private:
+	GLuint transformBuffer;
+	GLuint indexBuffer;        // 0, 1, 2, ... read with a divisor of one
+	GLsizeiptr transformCapacity;
+	GLuint indexCapacity;
+	std::vector<glm::mat4> models;
+	std::vector<glm::mat4> positionDecodes;
+	std::vector<glm::vec4> colors;
+	std::vector<ObjectTransform> records;
+};
@@ -0,0 +1,44 @@
+#include "MeshArena.h"
+#include <cstdint>
+
+MeshArena::MeshArena(size_t blockSize) : blockSize(blockSize), used(0), allocated(0) {}
+
+MeshArena::~MeshArena()
+{
+	reset();
+}
+
+void* MeshArena::allocate(size_t bytes, size_t alignment)
+{
+	if (!blocks.empty())
+	{
+		Block& block = blocks.back();
+		uintptr_t start = ((uintptr_t)block.memory + used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		size_t end = (size_t)(start - (uintptr_t)block.memory) + bytes;
+		if (end <= block.size)
+		{
+			used = end;
+			allocated += bytes;
+			return (void*)start;
+		}
+	}
+
+	// Requests bigger than a block get a block of their own
+	Block block;
+	block.size = bytes + alignment > blockSize ? bytes + alignment : blockSize;
+	block.memory = new unsigned char[block.size];
+	blocks.push_back(block);
+	uintptr_t start = ((uintptr_t)block.memory + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	used = (size_t)(start - (uintptr_t)block.memory) + bytes;
+	allocated += bytes;
+	return (void*)start;
+}
+
+void MeshArena::reset()
+{
+	for (size_t i = 0; i < blocks.size(); i++)
+		delete[] blocks[i].memory;
+	blocks.clear();
+	used = 0;
+	allocated = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Large enough that a scene's worth of generated meshes lands in one block
+const size_t MESH_ARENA_BLOCK_SIZE = 1 << 20;
+
+// Bump allocator for a batch of generated meshes. Allocations are carved out of a few large
+// blocks and are never freed one by one: reset() or the destructor releases all of them at
+// once. Meant for one thread at a time.
+class MeshArena
+{
+public:
+	explicit MeshArena(size_t blockSize = MESH_ARENA_BLOCK_SIZE);
+	~MeshArena();
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	void* allocate(size_t bytes, size_t alignment);
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		return (T*)allocate(count * sizeof(T), alignof(T));
+	}
+
+	// Releases every allocation; anything still pointing into the arena is left dangling
+	void reset();
+
+	size_t bytesAllocated() const { return allocated; }
+	size_t blockCount() const { return blocks.size(); }
+
+private:
+	struct Block
+	{
+		unsigned char* memory;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockSize;
+	size_t used;        // bytes taken from the last block
+	size_t allocated;
+};
@@ -0,0 +1,208 @@
+#include "MeshCache.h"
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char MESH_CACHE_MAGIC[4] = { 'S', 'H', 'P', 'C' };
+
+	uint64_t alignOffset(uint64_t offset)
+	{
+		return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+	}
+
+	// Pads the stream with zeros up to offset, then writes the section
+	void writeSection(std::ofstream& out, uint64_t& position, uint64_t offset, const void* bytes, size_t count)
+	{
+		static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+		out.write(zeros, (std::streamsize)(offset - position));
+		out.write((const char*)bytes, (std::streamsize)count);
+		position = offset + count;
+	}
+
+	// FNV-1a, continued from hash
+	uint64_t hashBytes(uint64_t hash, const void* bytes, size_t count)
+	{
+		const unsigned char* byte = (const unsigned char*)bytes;
+		for (size_t i = 0; i < count; i++)
+		{
+			hash ^= byte[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+uint64_t meshCacheKey(const char* name, const void* inputs, size_t inputSize)
+{
+	uint64_t hash = hashBytes(14695981039346656037ull, &MESH_GENERATOR_VERSION, sizeof(MESH_GENERATOR_VERSION));
+	hash = hashBytes(hash, name, strlen(name) + 1);
+	return hashBytes(hash, inputs, inputSize);
+}
+
+bool writeMeshCache(const char* path, uint64_t sourceKey, const ShapeData& shape, const PackedVertex* packedVertices,
+	const QuantizationBounds& quantization, const std::vector<MeshLod>& lods, const std::vector<MeshPart>& parts)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.headerSize = sizeof(MeshCacheHeader);
+	header.vertexSize = sizeof(Vertex);
+	header.packedVertexSize = sizeof(PackedVertex);
+	header.sourceKey = sourceKey;
+	header.vertexCount = shape.numVertices;
+	header.indexCount = shape.numIndices;
+	header.indexType = shape.indexType;
+	header.lodCount = (uint32_t)lods.size();
+	header.partCount = (uint32_t)parts.size();
+	header.vertexOffset = alignOffset(sizeof(MeshCacheHeader));
+	header.packedVertexOffset = alignOffset(header.vertexOffset + shape.vertexBufferSize());
+	header.indexOffset = alignOffset(header.packedVertexOffset + (uint64_t)shape.numVertices * sizeof(PackedVertex));
+	header.lodOffset = alignOffset(header.indexOffset + shape.indexBufferSize());
+	header.partOffset = alignOffset(header.lodOffset + lods.size() * sizeof(MeshLod));
+	header.fileSize = header.partOffset + parts.size() * sizeof(MeshPart);
+	header.bounds = shape.bounds;
+	header.quantization = quantization;
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+	uint64_t position = 0;
+	writeSection(out, position, 0, &header, sizeof(header));
+	writeSection(out, position, header.vertexOffset, shape.vertices, shape.vertexBufferSize());
+	writeSection(out, position, header.packedVertexOffset, packedVertices, shape.numVertices * sizeof(PackedVertex));
+	writeSection(out, position, header.indexOffset, shape.indices, shape.indexBufferSize());
+	writeSection(out, position, header.lodOffset, lods.data(), lods.size() * sizeof(MeshLod));
+	writeSection(out, position, header.partOffset, parts.data(), parts.size() * sizeof(MeshPart));
+	return (bool)out.flush();
+}
+
+MeshCacheFile::MeshCacheFile() :
+	data(0), size(0),
+#ifdef _WIN32
+	fileHandle(INVALID_HANDLE_VALUE), mappingHandle(0),
+#endif
+	header(0), packedStream(0), lodTable(0), partTable(0) {}
+
+MeshCacheFile::~MeshCacheFile()
+{
+	close();
+}
+
+bool MeshCacheFile::open(const char* path, uint64_t sourceKey)
+{
+	close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshCacheHeader))
+	{
+		close();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mappingHandle)
+	{
+		close();
+		return false;
+	}
+	data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(MeshCacheHeader))
+	{
+		::close(fd);
+		return false;
+	}
+	void* mapping = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping != MAP_FAILED)
+	{
+		data = (const unsigned char*)mapping;
+		size = (size_t)info.st_size;
+	}
+#endif
+	if (!data || !validate(sourceKey))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MeshCacheFile::validate(uint64_t sourceKey)
+{
+	const MeshCacheHeader* candidate = (const MeshCacheHeader*)data;
+	if (memcmp(candidate->magic, MESH_CACHE_MAGIC, sizeof(candidate->magic)) != 0 || candidate->version != MESH_CACHE_VERSION
+		|| candidate->headerSize != sizeof(MeshCacheHeader) || candidate->vertexSize != sizeof(Vertex)
+		|| candidate->packedVertexSize != sizeof(PackedVertex) || candidate->sourceKey != sourceKey || candidate->fileSize != size)
+		return false;
+	if (candidate->indexType != GL_UNSIGNED_SHORT && candidate->indexType != GL_UNSIGNED_INT)
+		return false;
+
+	// Every section has to lie inside the file, on its alignment
+	uint64_t indexSize = candidate->indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	uint64_t sections[][2] = {
+		{ candidate->vertexOffset, (uint64_t)candidate->vertexCount * sizeof(Vertex) },
+		{ candidate->packedVertexOffset, (uint64_t)candidate->vertexCount * sizeof(PackedVertex) },
+		{ candidate->indexOffset, (uint64_t)candidate->indexCount * indexSize },
+		{ candidate->lodOffset, (uint64_t)candidate->lodCount * sizeof(MeshLod) },
+		{ candidate->partOffset, (uint64_t)candidate->partCount * sizeof(MeshPart) },
+	};
+	for (const uint64_t* section : sections)
+	{
+		if (section[0] % MESH_CACHE_ALIGNMENT != 0 || section[0] > size || section[1] > size - section[0])
+			return false;
+	}
+
+	header = candidate;
+	mapped = ShapeData::wrap((Vertex*)(data + header->vertexOffset), header->vertexCount,
+		(void*)(data + header->indexOffset), header->indexCount, header->indexType);
+	mapped.bounds = header->bounds;
+	packedStream = (const PackedVertex*)(data + header->packedVertexOffset);
+	lodTable = (const MeshLod*)(data + header->lodOffset);
+	partTable = (const MeshPart*)(data + header->partOffset);
+	return true;
+}
+
+void MeshCacheFile::close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = 0;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+		munmap((void*)data, size);
+#endif
+	data = 0;
+	size = 0;
+	header = 0;
+	mapped = ShapeData();
+	packedStream = 0;
+	lodTable = 0;
+	partTable = 0;
+}
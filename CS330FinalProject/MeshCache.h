@@ -0,0 +1,101 @@
+#pragma once
+#include "ShapeData.h"
+#include "MeshSimplifier.h"
+#include "PackedVertex.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bumped whenever the layout below changes; older files are then ignored and rewritten
+const uint32_t MESH_CACHE_VERSION = 2;
+// Bumped whenever ShapeGenerator, MeshOptimizer, MeshSimplifier or the scene assembly change what
+// they make from the same inputs. It seeds every key, so the old cache files then miss.
+const uint32_t MESH_GENERATOR_VERSION = 1;
+// Every section starts on this boundary so the mapped streams can be used in place
+const size_t MESH_CACHE_ALIGNMENT = 64;
+
+// Index range of a mesh with its own bounds, such as one object of a combined scene
+struct MeshPart
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	BoundingVolume bounds;
+};
+
+// A cache file is this header followed by the vertex stream (Vertex), the packed vertex stream
+// (PackedVertex, quantized against the header's quantization box), the index stream (indexType),
+// the LOD table (MeshLod) and the part table (MeshPart), each at its offset. Fields are in the
+// writing machine's byte order; the sizes catch files from a build with a different layout.
+struct MeshCacheHeader
+{
+	char magic[4];          // "SHPC"
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t vertexSize;
+	uint64_t sourceKey;     // identifies the generator inputs; a different key means the file is stale
+	uint64_t fileSize;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexType;
+	uint32_t lodCount;
+	uint32_t partCount;
+	uint32_t packedVertexSize;
+	uint64_t vertexOffset;
+	uint64_t packedVertexOffset;
+	uint64_t indexOffset;
+	uint64_t lodOffset;
+	uint64_t partOffset;
+	BoundingVolume bounds;
+	QuantizationBounds quantization;
+};
+
+// FNV-1a hash of MESH_GENERATOR_VERSION, a mesh's name and the raw bytes of every input its
+// generator reads; inputs has to be free of padding
+uint64_t meshCacheKey(const char* name, const void* inputs, size_t inputSize);
+
+// packedVertices holds shape.numVertices vertices packed against quantization
+bool writeMeshCache(const char* path, uint64_t sourceKey, const ShapeData& shape, const PackedVertex* packedVertices,
+	const QuantizationBounds& quantization, const std::vector<MeshLod>& lods, const std::vector<MeshPart>& parts);
+
+// Read-only memory mapping of a cache file. Nothing is parsed or copied: shape(),
+// packedVertices(), lods() and parts() point into the mapping, so they are only valid while
+// the file stays open. The shape borrows its arrays (see ShapeData::view) and must not be
+// written to.
+class MeshCacheFile
+{
+public:
+	MeshCacheFile();
+	~MeshCacheFile();
+	MeshCacheFile(const MeshCacheFile&) = delete;
+	MeshCacheFile& operator=(const MeshCacheFile&) = delete;
+
+	// False when the file is missing, truncated, from another version or build, or was
+	// written for a different sourceKey
+	bool open(const char* path, uint64_t sourceKey);
+	void close();
+	bool isOpen() const { return data != 0; }
+
+	const ShapeData& shape() const { return mapped; }
+	// GPU-ready copy of shape()'s vertices, uploaded as is
+	const PackedVertex* packedVertices() const { return packedStream; }
+	const QuantizationBounds& quantization() const { return header->quantization; }
+	const MeshLod* lods() const { return lodTable; }
+	uint32_t lodCount() const { return header ? header->lodCount : 0; }
+	const MeshPart* parts() const { return partTable; }
+	uint32_t partCount() const { return header ? header->partCount : 0; }
+
+private:
+	bool validate(uint64_t sourceKey);
+
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+	const MeshCacheHeader* header;
+	ShapeData mapped;
+	const PackedVertex* packedStream;
+	const MeshLod* lodTable;
+	const MeshPart* partTable;
+};
@@ -0,0 +1,229 @@
+#include "MeshOptimizer.h"
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Forsyth's tuning: an LRU cache a little larger than real hardware, a flat score for
+	// the last triangle's vertices and a bonus for vertices with few triangles left
+	const int SCORE_CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	float vertexScore(int cachePosition, GLuint remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+				score = LAST_TRIANGLE_SCORE;
+			else
+				score = powf(1.0f - (cachePosition - 3) / (float)(SCORE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+		return score + VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+	}
+
+	// Reorders one list of triangles whose vertex indices are all below vertexCount
+	void forsythReorder(GLuint* indices, GLuint triangleCount, GLuint vertexCount)
+	{
+		// Triangle lists per vertex in one flat array
+		std::vector<GLuint> adjacencyStart(vertexCount + 1, 0);
+		for (GLuint i = 0; i < triangleCount * 3; i++)
+			adjacencyStart[indices[i] + 1]++;
+		for (GLuint v = 0; v < vertexCount; v++)
+			adjacencyStart[v + 1] += adjacencyStart[v];
+		std::vector<GLuint> adjacency(triangleCount * 3);
+		std::vector<GLuint> remaining(vertexCount, 0);
+		for (GLuint t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = indices[t * 3 + k];
+				adjacency[adjacencyStart[v] + remaining[v]++] = t;
+			}
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (GLuint v = 0; v < vertexCount; v++)
+			vertexScores[v] = vertexScore(-1, remaining[v]);
+
+		std::vector<float> triangleScores(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		for (GLuint t = 0; t < triangleCount; t++)
+			triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+		std::vector<GLuint> output(triangleCount * 3);
+		int cache[SCORE_CACHE_SIZE + 3];
+		int cacheCount = 0;
+		GLuint scanCursor = 0;
+		GLuint best = 0;
+		float bestScore = -1.0f;
+		for (GLuint t = 0; t < triangleCount; t++)
+		{
+			if (triangleScores[t] > bestScore)
+			{
+				bestScore = triangleScores[t];
+				best = t;
+			}
+		}
+
+		for (GLuint written = 0; written < triangleCount; written++)
+		{
+			// Nothing in the cache touches a live triangle; take the next one in input order
+			if (bestScore < 0.0f)
+			{
+				while (emitted[scanCursor])
+					scanCursor++;
+				best = scanCursor;
+			}
+
+			emitted[best] = true;
+			const GLuint* tri = &indices[best * 3];
+			memcpy(&output[written * 3], tri, sizeof(GLuint) * 3);
+
+			// Retire the triangle from its vertices' lists
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = tri[k];
+				GLuint* list = &adjacency[adjacencyStart[v]];
+				for (GLuint i = 0; i < remaining[v]; i++)
+				{
+					if (list[i] == best)
+					{
+						list[i] = list[remaining[v] - 1];
+						break;
+					}
+				}
+				remaining[v]--;
+			}
+
+			// Move the triangle's vertices to the front of the LRU cache
+			int newCache[SCORE_CACHE_SIZE + 3];
+			int newCount = 0;
+			for (int k = 0; k < 3; k++)
+				newCache[newCount++] = (int)tri[k];
+			for (int i = 0; i < cacheCount; i++)
+			{
+				int v = cache[i];
+				if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+					newCache[newCount++] = v;
+			}
+			for (int i = SCORE_CACHE_SIZE; i < newCount; i++)
+				cachePosition[newCache[i]] = -1;
+			cacheCount = newCount < SCORE_CACHE_SIZE ? newCount : SCORE_CACHE_SIZE;
+			memcpy(cache, newCache, sizeof(int) * cacheCount);
+
+			// Rescore cached vertices and every live triangle they touch; evicted vertices
+			// only lose score, so their triangles cannot overtake a cached candidate
+			for (int i = 0; i < newCount; i++)
+			{
+				int v = newCache[i];
+				if (i < SCORE_CACHE_SIZE)
+					cachePosition[v] = i;
+				float score = vertexScore(cachePosition[v], remaining[v]);
+				float delta = score - vertexScores[v];
+				vertexScores[v] = score;
+				const GLuint* list = &adjacency[adjacencyStart[v]];
+				for (GLuint j = 0; j < remaining[v]; j++)
+					triangleScores[list[j]] += delta;
+			}
+
+			bestScore = -1.0f;
+			for (int i = 0; i < cacheCount; i++)
+			{
+				int v = cache[i];
+				const GLuint* list = &adjacency[adjacencyStart[v]];
+				for (GLuint j = 0; j < remaining[v]; j++)
+				{
+					if (triangleScores[list[j]] > bestScore)
+					{
+						bestScore = triangleScores[list[j]];
+						best = list[j];
+					}
+				}
+			}
+		}
+		memcpy(indices, output.data(), sizeof(GLuint) * triangleCount * 3);
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const ShapeData& shape, GLuint cacheSize)
+{
+	VertexCacheStats stats = {};
+	if (shape.numIndices == 0)
+		return stats;
+
+	// Each slot holds the time the vertex entered the FIFO; it is resident while newer than the oldest slot
+	std::vector<GLuint> insertedAt(shape.numVertices, 0);
+	std::vector<bool> referenced(shape.numVertices, false);
+	GLuint misses = 0;
+	GLuint usedVertices = 0;
+	for (GLuint i = 0; i < shape.numIndices; i++)
+	{
+		GLuint v = shape.index(i);
+		if (!referenced[v])
+		{
+			referenced[v] = true;
+			usedVertices++;
+		}
+		if (insertedAt[v] == 0 || misses - insertedAt[v] + 1 > cacheSize)
+		{
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+	stats.acmr = misses / (float)(shape.numIndices / 3);
+	stats.atvr = misses / (float)usedVertices;
+	return stats;
+}
+
+void optimizeVertexCache(ShapeData& shape, GLuint firstIndex, GLuint indexCount)
+{
+	GLuint triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// Work on a 32-bit copy so one code path serves both index widths
+	std::vector<GLuint> indices(triangleCount * 3);
+	for (GLuint i = 0; i < triangleCount * 3; i++)
+		indices[i] = shape.index(firstIndex + i);
+	forsythReorder(indices.data(), triangleCount, shape.numVertices);
+	for (GLuint i = 0; i < triangleCount * 3; i++)
+		shape.setIndex(firstIndex + i, indices[i]);
+}
+
+void optimizeVertexCache(ShapeData& shape)
+{
+	optimizeVertexCache(shape, 0, shape.numIndices);
+}
+
+void optimizeVertexFetch(ShapeData& shape)
+{
+	const GLuint UNMAPPED = 0xffffffffu;
+	std::vector<GLuint> remap(shape.numVertices, UNMAPPED);
+	GLuint next = 0;
+	for (GLuint i = 0; i < shape.numIndices; i++)
+	{
+		GLuint v = shape.index(i);
+		if (remap[v] == UNMAPPED)
+			remap[v] = next++;
+		shape.setIndex(i, remap[v]);
+	}
+	for (GLuint v = 0; v < shape.numVertices; v++)
+	{
+		if (remap[v] == UNMAPPED)
+			remap[v] = next++;
+	}
+
+	// Scattered back into the shape's own array, which may live in an arena
+	std::vector<Vertex> original(shape.vertices, shape.vertices + shape.numVertices);
+	for (GLuint v = 0; v < shape.numVertices; v++)
+		shape.vertices[remap[v]] = original[v];
+}
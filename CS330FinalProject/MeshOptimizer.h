@@ -0,0 +1,21 @@
+#pragma once
+#include "ShapeData.h"
+
+// Post-transform cache behaviour of an index buffer, simulated with a FIFO cache
+struct VertexCacheStats
+{
+	float acmr;  // vertices transformed per triangle; 0.5 is the ideal for a large regular grid, 3.0 the worst
+	float atvr;  // vertices transformed per referenced vertex; 1.0 means every vertex is shaded once
+};
+
+VertexCacheStats analyzeVertexCache(const ShapeData& shape, GLuint cacheSize = 16);
+
+// Reorders the triangles of [firstIndex, firstIndex + indexCount) for post-transform cache
+// hits (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"). Triangles never leave the
+// range, so draw ranges that start part way into the index buffer stay valid.
+void optimizeVertexCache(ShapeData& shape, GLuint firstIndex, GLuint indexCount);
+void optimizeVertexCache(ShapeData& shape);
+
+// Renumbers vertices in the order the index buffer first references them so vertex fetch
+// walks memory forwards. Unreferenced vertices are moved to the end.
+void optimizeVertexFetch(ShapeData& shape);
@@ -0,0 +1,458 @@
+#include "MeshSimplifier.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Weight of a collapse's squared normal and UV change, relative to the squared mesh radius
+	const double ATTRIBUTE_WEIGHT = 0.01;
+	const GLuint NO_VERTEX = 0xffffffffu;
+
+	// Symmetric 4x4 quadric summing squared distances to a set of area-weighted planes
+	struct Quadric
+	{
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	Quadric planeQuadric(const glm::vec3& normal, float distance, float weight)
+	{
+		double x = normal.x, y = normal.y, z = normal.z, d = distance, w = weight;
+		Quadric q;
+		q.a00 = w * x * x;
+		q.a01 = w * x * y;
+		q.a02 = w * x * z;
+		q.a11 = w * y * y;
+		q.a12 = w * y * z;
+		q.a22 = w * z * z;
+		q.b0 = w * x * d;
+		q.b1 = w * y * d;
+		q.b2 = w * z * d;
+		q.c = w * d * d;
+		q.weight = w;
+		return q;
+	}
+
+	void addQuadric(Quadric& to, const Quadric& from)
+	{
+		to.a00 += from.a00;
+		to.a01 += from.a01;
+		to.a02 += from.a02;
+		to.a11 += from.a11;
+		to.a12 += from.a12;
+		to.a22 += from.a22;
+		to.b0 += from.b0;
+		to.b1 += from.b1;
+		to.b2 += from.b2;
+		to.c += from.c;
+		to.weight += from.weight;
+	}
+
+	// Mean squared distance from p to the quadric's planes
+	double quadricError(const Quadric& q, const glm::vec3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+			+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+			+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+		return q.weight > 0.0 ? fabs(e) / q.weight : 0.0;
+	}
+
+	// Distance from p to the triangle abc (Ericson, "Real-Time Collision Detection", 5.1.5)
+	float pointTriangleDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			return glm::length(ap);
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)
+			return glm::length(bp);
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			return glm::length(ap - ab * (d1 / (d1 - d3)));
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)
+			return glm::length(cp);
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			return glm::length(ap - ac * (d2 / (d2 - d6)));
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+			return glm::length(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		float denominator = 1.0f / (va + vb + vc);
+		return glm::length(ap - ab * (vb * denominator) - ac * (vc * denominator));
+	}
+
+	inline unsigned long long edgeKey(GLuint from, GLuint to)
+	{
+		return ((unsigned long long)from << 32) | to;
+	}
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			unsigned int bits[3];
+			memcpy(bits, &p[0], sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	// How a position may move. Manifold vertices have one set of attributes and collapse onto
+	// any neighbour; seam vertices have two, split along a line of edges, and collapse along it.
+	// Borders, corners where three or more attribute sets meet and non-manifold fans stay put.
+	enum VertexKind
+	{
+		KIND_MANIFOLD,
+		KIND_SEAM,
+		KIND_LOCKED
+	};
+
+	struct Collapse
+	{
+		GLuint from, to;          // positions, named by their first vertex
+		GLuint wedgeTargets[2];   // vertex of 'to' that each vertex at 'from' becomes
+		double cost;              // ranks collapses: quadric error plus the attribute change
+		float distance;           // from the removed position to the fan that replaces it
+	};
+
+	class QuadricSimplifier
+	{
+	public:
+		QuadricSimplifier(const ShapeData& shape, GLuint firstIndex, GLuint indexCount);
+
+		// Collapses edges, cheapest first, until at most targetIndexCount indices remain or none can go
+		void simplifyTo(GLuint targetIndexCount);
+
+		const std::vector<GLuint>& result() const { return indices; }
+		// Bound on how far the original surface lies from the simplified one, in mesh units
+		float error() const { return maxDistance; }
+
+	private:
+		void classify();
+		bool evaluate(GLuint from, GLuint to, Collapse& collapse) const;
+		bool collapsePass(GLuint targetTriangles);
+
+		const Vertex* vertices;
+		GLuint vertexCount;
+		std::vector<GLuint> indices;     // live triangles
+		std::vector<GLuint> canonical;   // first vertex with the same position as each vertex
+		std::vector<Quadric> quadrics;   // per position
+		double attributeScale;
+		// Per position, how far the original surface it stands in for may lie from it
+		std::vector<float> positionError;
+		float maxDistance;
+
+		// Rebuilt every pass from the live triangles
+		std::vector<GLuint> triangleStart;
+		std::vector<GLuint> triangleList;
+		std::vector<GLuint> wedges[2];
+		std::vector<unsigned char> kind;
+	};
+
+	QuadricSimplifier::QuadricSimplifier(const ShapeData& shape, GLuint firstIndex, GLuint indexCount) :
+		vertices(shape.vertices), vertexCount(shape.numVertices), attributeScale(0.0), maxDistance(0.0f)
+	{
+		GLuint triangleCount = indexCount / 3;
+		indices.resize(triangleCount * 3);
+		for (GLuint i = 0; i < triangleCount * 3; i++)
+			indices[i] = shape.index(firstIndex + i);
+
+		// Vertices that differ only in normal or UV are one position; adding zero folds -0 into +0
+		std::unordered_map<glm::vec3, GLuint, PositionHash> positions;
+		canonical.resize(vertexCount);
+		for (GLuint v = 0; v < vertexCount; v++)
+			canonical[v] = positions.emplace(vertices[v].position + glm::vec3(0.0f), v).first->second;
+
+		quadrics.assign(vertexCount, Quadric());
+		positionError.assign(vertexCount, 0.0f);
+		glm::vec3 low(0.0f), high(0.0f);
+		if (!indices.empty())
+			low = high = vertices[indices[0]].position;
+		for (GLuint t = 0; t < triangleCount; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3]].position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+			low = glm::min(low, glm::min(p0, glm::min(p1, p2)));
+			high = glm::max(high, glm::max(p0, glm::max(p1, p2)));
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length <= 0.0f)
+				continue;
+			normal /= length;
+			Quadric plane = planeQuadric(normal, -glm::dot(normal, p0), 0.5f * length);
+			for (int k = 0; k < 3; k++)
+				addQuadric(quadrics[canonical[indices[t * 3 + k]]], plane);
+		}
+
+		double radius = 0.5 * glm::length(high - low);
+		attributeScale = ATTRIBUTE_WEIGHT * radius * radius;
+	}
+
+	void QuadricSimplifier::simplifyTo(GLuint targetIndexCount)
+	{
+		GLuint targetTriangles = targetIndexCount / 3;
+		while (indices.size() / 3 > targetTriangles && collapsePass(targetTriangles))
+			;
+	}
+
+	void QuadricSimplifier::classify()
+	{
+		GLuint cornerCount = (GLuint)indices.size();
+
+		// Triangles around each position in one flat array
+		triangleStart.assign(vertexCount + 1, 0);
+		for (GLuint i = 0; i < cornerCount; i++)
+			triangleStart[canonical[indices[i]] + 1]++;
+		for (GLuint v = 0; v < vertexCount; v++)
+			triangleStart[v + 1] += triangleStart[v];
+		triangleList.resize(cornerCount);
+		std::vector<GLuint> fill(triangleStart.begin(), triangleStart.end() - 1);
+		for (GLuint i = 0; i < cornerCount; i++)
+			triangleList[fill[canonical[indices[i]]]++] = i / 3;
+
+		// An edge is open when no triangle walks it the other way; open between vertices but
+		// closed between positions is an attribute seam, open between positions is a border
+		std::unordered_set<unsigned long long> vertexEdges, positionEdges;
+		vertexEdges.reserve(cornerCount);
+		positionEdges.reserve(cornerCount);
+		for (GLuint i = 0; i < cornerCount; i++)
+		{
+			GLuint a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+			vertexEdges.insert(edgeKey(a, b));
+			positionEdges.insert(edgeKey(canonical[a], canonical[b]));
+		}
+
+		std::vector<unsigned char> wedgeCount(vertexCount, 0), openOut(vertexCount, 0), openIn(vertexCount, 0);
+		std::vector<bool> border(vertexCount, false);
+		wedges[0].assign(vertexCount, NO_VERTEX);
+		wedges[1].assign(vertexCount, NO_VERTEX);
+		for (GLuint i = 0; i < cornerCount; i++)
+		{
+			GLuint a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+			GLuint p = canonical[a];
+			if (a != wedges[0][p] && a != wedges[1][p] && wedgeCount[p] < 3)
+			{
+				if (wedgeCount[p] < 2)
+					wedges[wedgeCount[p]][p] = a;
+				wedgeCount[p]++;
+			}
+
+			if (!vertexEdges.count(edgeKey(b, a)))
+			{
+				openOut[a]++;
+				openIn[b]++;
+			}
+			if (!positionEdges.count(edgeKey(canonical[b], canonical[a])))
+				border[canonical[a]] = border[canonical[b]] = true;
+		}
+
+		kind.assign(vertexCount, KIND_LOCKED);
+		for (GLuint p = 0; p < vertexCount; p++)
+		{
+			if (wedgeCount[p] == 0 || border[p])
+				continue;
+			GLuint w0 = wedges[0][p], w1 = wedges[1][p];
+			if (wedgeCount[p] == 1 && openOut[w0] == 0 && openIn[w0] == 0)
+				kind[p] = KIND_MANIFOLD;
+			else if (wedgeCount[p] == 2 && openOut[w0] == 1 && openIn[w0] == 1 && openOut[w1] == 1 && openIn[w1] == 1)
+				kind[p] = KIND_SEAM;
+		}
+	}
+
+	bool QuadricSimplifier::evaluate(GLuint from, GLuint to, Collapse& collapse) const
+	{
+		if (kind[from] == KIND_LOCKED)
+			return false;
+
+		// Every vertex at 'from' must share an edge with a vertex at 'to'. Seam vertices only
+		// find one on both sides when the edge runs along the seam.
+		int wedgeCount = kind[from] == KIND_SEAM ? 2 : 1;
+		for (int k = 0; k < wedgeCount; k++)
+		{
+			GLuint wedge = wedges[k][from];
+			GLuint target = NO_VERTEX;
+			for (GLuint j = triangleStart[from]; j < triangleStart[from + 1] && target == NO_VERTEX; j++)
+			{
+				const GLuint* tri = &indices[triangleList[j] * 3];
+				if (tri[0] != wedge && tri[1] != wedge && tri[2] != wedge)
+					continue;
+				for (int c = 0; c < 3; c++)
+				{
+					if (canonical[tri[c]] == to)
+						target = tri[c];
+				}
+			}
+			if (target == NO_VERTEX)
+				return false;
+			collapse.wedgeTargets[k] = target;
+		}
+
+		// Triangles that survive the collapse must not turn over. The removed position's
+		// distance to them is how far the surface moves.
+		const glm::vec3& source = vertices[from].position;
+		const glm::vec3& destination = vertices[to].position;
+		float distance = glm::length(source - destination);
+		for (GLuint j = triangleStart[from]; j < triangleStart[from + 1]; j++)
+		{
+			const GLuint* tri = &indices[triangleList[j] * 3];
+			if (canonical[tri[0]] == to || canonical[tri[1]] == to || canonical[tri[2]] == to)
+				continue;
+			glm::vec3 before[3], after[3];
+			for (int c = 0; c < 3; c++)
+			{
+				before[c] = vertices[tri[c]].position;
+				after[c] = canonical[tri[c]] == from ? destination : before[c];
+			}
+			glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(normalBefore, normalAfter) <= 0.0f && glm::dot(normalBefore, normalBefore) > 0.0f)
+				return false;
+			distance = fminf(distance, pointTriangleDistance(source, after[0], after[1], after[2]));
+		}
+
+		Quadric merged = quadrics[from];
+		addQuadric(merged, quadrics[to]);
+		double cost = quadricError(merged, destination);
+		for (int k = 0; k < wedgeCount; k++)
+		{
+			const Vertex& a = vertices[wedges[k][from]];
+			const Vertex& b = vertices[collapse.wedgeTargets[k]];
+			glm::vec3 dn = a.normal - b.normal;
+			glm::vec2 duv = a.uv - b.uv;
+			cost += attributeScale * (glm::dot(dn, dn) + glm::dot(duv, duv));
+		}
+
+		collapse.from = from;
+		collapse.to = to;
+		collapse.cost = cost;
+		collapse.distance = distance;
+		return true;
+	}
+
+	bool QuadricSimplifier::collapsePass(GLuint targetTriangles)
+	{
+		classify();
+
+		// Cheaper direction of every edge, seen from the triangle that walks it low to high
+		std::vector<Collapse> candidates;
+		for (GLuint i = 0; i < indices.size(); i++)
+		{
+			GLuint a = canonical[indices[i]];
+			GLuint b = canonical[indices[i - i % 3 + (i + 1) % 3]];
+			if (a >= b)
+				continue;
+			Collapse forward, backward;
+			bool canForward = evaluate(a, b, forward);
+			bool canBackward = evaluate(b, a, backward);
+			if (canForward && (!canBackward || forward.cost <= backward.cost))
+				candidates.push_back(forward);
+			else if (canBackward)
+				candidates.push_back(backward);
+		}
+		std::sort(candidates.begin(), candidates.end(),
+			[](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+		// Collapses in one pass must not share triangles, so each one locks the fan it reshapes
+		std::vector<GLuint> wedgeTarget(vertexCount);
+		for (GLuint v = 0; v < vertexCount; v++)
+			wedgeTarget[v] = v;
+		std::vector<bool> touched(vertexCount, false);
+		GLuint remaining = (GLuint)indices.size() / 3;
+		bool collapsed = false;
+		for (const Collapse& collapse : candidates)
+		{
+			if (remaining <= targetTriangles)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			GLuint removed = 0;
+			for (GLuint j = triangleStart[collapse.from]; j < triangleStart[collapse.from + 1]; j++)
+			{
+				const GLuint* tri = &indices[triangleList[j] * 3];
+				bool hasTarget = false;
+				for (int c = 0; c < 3; c++)
+				{
+					touched[canonical[tri[c]]] = true;
+					hasTarget = hasTarget || canonical[tri[c]] == collapse.to;
+				}
+				if (hasTarget)
+					removed++;
+			}
+
+			int wedgeCount = kind[collapse.from] == KIND_SEAM ? 2 : 1;
+			for (int k = 0; k < wedgeCount; k++)
+				wedgeTarget[wedges[k][collapse.from]] = collapse.wedgeTargets[k];
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			// Surface already merged into 'from' is at most its own error plus this step away
+			float error = std::max(positionError[collapse.to], positionError[collapse.from] + collapse.distance);
+			positionError[collapse.to] = error;
+			maxDistance = std::max(maxDistance, error);
+			remaining = remaining > removed ? remaining - removed : 0;
+			collapsed = true;
+		}
+		if (!collapsed)
+			return false;
+
+		// Move the collapsed vertices and drop the triangles that lost an edge
+		size_t written = 0;
+		for (size_t t = 0; t < indices.size() / 3; t++)
+		{
+			GLuint a = wedgeTarget[indices[t * 3]];
+			GLuint b = wedgeTarget[indices[t * 3 + 1]];
+			GLuint c = wedgeTarget[indices[t * 3 + 2]];
+			if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c])
+				continue;
+			indices[written++] = a;
+			indices[written++] = b;
+			indices[written++] = c;
+		}
+		indices.resize(written);
+		return true;
+	}
+}
+
+std::vector<MeshLod> buildLodChain(ShapeData& shape, GLuint firstIndex, GLuint indexCount, const float* triangleRatios, int ratioCount)
+{
+	std::vector<MeshLod> lods;
+	MeshLod full = { firstIndex, indexCount, 0.0f };
+	lods.push_back(full);
+
+	QuadricSimplifier simplifier(shape, firstIndex, indexCount);
+	for (int i = 0; i < ratioCount; i++)
+	{
+		GLuint target = (GLuint)(indexCount / 3 * triangleRatios[i]) * 3;
+		simplifier.simplifyTo(target);
+
+		const std::vector<GLuint>& simplified = simplifier.result();
+		if (simplified.empty() || simplified.size() >= lods.back().indexCount)
+			continue;
+
+		MeshLod lod = { shape.numIndices, (GLuint)simplified.size(), simplifier.error() };
+		shape.resizeIndices(lod.firstIndex + lod.indexCount);
+		for (GLuint j = 0; j < lod.indexCount; j++)
+			shape.setIndex(lod.firstIndex + j, simplified[j]);
+		lods.push_back(lod);
+	}
+	return lods;
+}
+
+int selectLod(const std::vector<MeshLod>& lods, float pixelsPerUnit, float maxPixelError)
+{
+	int selected = 0;
+	for (int i = 1; i < (int)lods.size() && lods[i].error * pixelsPerUnit <= maxPixelError; i++)
+		selected = i;
+	return selected;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "ShapeData.h"
+#include <vector>
+
+// One level of detail: a range of the shape's index buffer over the shared vertices
+struct MeshLod
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	float error;        // bound on the distance from the full mesh's surface, in mesh space units
+};
+
+// Simplifies [firstIndex, firstIndex + indexCount) by quadric error edge collapse
+// (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics"). Each vertex
+// collapses onto a neighbour, so no vertices are added and the vertex buffer is shared by
+// every level. Collapses are ranked by quadric error plus the normal/UV change they cause;
+// UV and normal seams only collapse along the seam, and open borders are locked so
+// silhouettes and the joins between combined parts stay put. A level's error leaves the
+// ranking terms out and only measures how far the surface moved.
+//
+// Levels are appended to the shape's index buffer, one per ratio of the original triangle
+// count, each simplified further from the last. Element 0 is the original range. A level is
+// skipped when the mesh cannot get any smaller.
+std::vector<MeshLod> buildLodChain(ShapeData& shape, GLuint firstIndex, GLuint indexCount, const float* triangleRatios, int ratioCount);
+
+// Coarsest level whose error, times pixelsPerUnit, stays within maxPixelError
+int selectLod(const std::vector<MeshLod>& lods, float pixelsPerUnit, float maxPixelError);
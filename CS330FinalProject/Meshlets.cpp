@@ -0,0 +1,270 @@
+#include "Meshlets.h"
+#include "Frustum.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <cfloat>
+
+namespace
+{
+	const GLuint NO_MESHLET = 0xffffffffu;
+	const GLuint NO_TRIANGLE = 0xffffffffu;
+
+	glm::vec3 triangleCentroid(const ShapeData& shape, const GLuint* tri)
+	{
+		return (shape.vertices[tri[0]].position + shape.vertices[tri[1]].position + shape.vertices[tri[2]].position) / 3.0f;
+	}
+
+	// Bounding sphere around the meshlet's vertices and a cone bounding its face normals
+	void computeBounds(const ShapeData& shape, const GLuint* indices, const std::vector<GLuint>& members, Meshlet& meshlet)
+	{
+		glm::vec3 low = shape.vertices[members[0]].position, high = low;
+		for (size_t i = 1; i < members.size(); i++)
+		{
+			low = glm::min(low, shape.vertices[members[i]].position);
+			high = glm::max(high, shape.vertices[members[i]].position);
+		}
+		meshlet.center = (low + high) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (size_t i = 0; i < members.size(); i++)
+			meshlet.radius = fmaxf(meshlet.radius, glm::length(shape.vertices[members[i]].position - meshlet.center));
+
+		// Area-weighted mean normal as the axis
+		glm::vec3 axis(0.0f);
+		for (GLuint t = 0; t < meshlet.triangleCount; t++)
+		{
+			const GLuint* tri = indices + t * 3;
+			const glm::vec3& p0 = shape.vertices[tri[0]].position;
+			axis += glm::cross(shape.vertices[tri[1]].position - p0, shape.vertices[tri[2]].position - p0);
+		}
+		meshlet.coneApex = meshlet.center;
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		float axisLength = glm::length(axis);
+		if (axisLength <= 0.0f)
+			return;
+		axis /= axisLength;
+
+		// Widest angle between the axis and a face; at 90 degrees or more nothing can be culled
+		float minDot = 1.0f;
+		for (GLuint t = 0; t < meshlet.triangleCount; t++)
+		{
+			const GLuint* tri = indices + t * 3;
+			const glm::vec3& p0 = shape.vertices[tri[0]].position;
+			glm::vec3 normal = glm::cross(shape.vertices[tri[1]].position - p0, shape.vertices[tri[2]].position - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+				minDot = fminf(minDot, glm::dot(axis, normal / length));
+		}
+		meshlet.coneAxis = axis;
+		if (minDot <= 0.0f)
+			return;
+
+		// Back the apex off along the axis until every triangle's plane is in front of it
+		float maxT = 0.0f;
+		for (GLuint t = 0; t < meshlet.triangleCount; t++)
+		{
+			const GLuint* tri = indices + t * 3;
+			const glm::vec3& p0 = shape.vertices[tri[0]].position;
+			glm::vec3 normal = glm::cross(shape.vertices[tri[1]].position - p0, shape.vertices[tri[2]].position - p0);
+			float length = glm::length(normal);
+			if (length <= 0.0f)
+				continue;
+			normal /= length;
+			maxT = fmaxf(maxT, glm::dot(meshlet.center - p0, normal) / glm::dot(axis, normal));
+		}
+		meshlet.coneApex = meshlet.center - axis * maxT;
+		meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+
+	template <typename Index>
+	void copyMeshletIndices(const GLuint* source, GLuint count, unsigned char* stream, GLuint streamOffset)
+	{
+		Index* out = (Index*)stream + streamOffset;
+		for (GLuint i = 0; i < count; i++)
+			out[i] = (Index)source[i];
+	}
+}
+
+std::vector<Meshlet> buildMeshlets(const ShapeData& shape, GLuint firstIndex, GLuint indexCount, std::vector<GLuint>& indices)
+{
+	GLuint triangleCount = indexCount / 3;
+	std::vector<GLuint> source(triangleCount * 3);
+	for (GLuint i = 0; i < triangleCount * 3; i++)
+		source[i] = shape.index(firstIndex + i);
+
+	// Triangle lists per vertex in one flat array
+	std::vector<GLuint> adjacencyStart(shape.numVertices + 1, 0);
+	for (GLuint i = 0; i < triangleCount * 3; i++)
+		adjacencyStart[source[i] + 1]++;
+	for (GLuint v = 0; v < shape.numVertices; v++)
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	std::vector<GLuint> adjacency(triangleCount * 3);
+	std::vector<GLuint> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (GLuint i = 0; i < triangleCount * 3; i++)
+		adjacency[fill[source[i]]++] = i / 3;
+
+	std::vector<Meshlet> meshlets;
+	indices.clear();
+	indices.reserve(triangleCount * 3);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<GLuint> meshletOf(shape.numVertices, NO_MESHLET);
+	std::vector<GLuint> members;
+	GLuint seed = 0;
+	for (;;)
+	{
+		while (seed < triangleCount && emitted[seed])
+			seed++;
+		if (seed == triangleCount)
+			break;
+
+		GLuint id = (GLuint)meshlets.size();
+		Meshlet meshlet = {};
+		meshlet.firstIndex = (GLuint)indices.size();
+		members.clear();
+		glm::vec3 centroidSum(0.0f);
+		GLuint next = seed;
+		while (next != NO_TRIANGLE)
+		{
+			const GLuint* tri = &source[next * 3];
+			emitted[next] = true;
+			for (int k = 0; k < 3; k++)
+			{
+				if (meshletOf[tri[k]] != id)
+				{
+					meshletOf[tri[k]] = id;
+					members.push_back(tri[k]);
+				}
+				indices.push_back(tri[k]);
+			}
+			centroidSum += triangleCentroid(shape, tri);
+			if (++meshlet.triangleCount == MESHLET_MAX_TRIANGLES)
+				break;
+
+			// Grow through the neighbour that adds the fewest vertices, then the one nearest the patch
+			glm::vec3 centroid = centroidSum / (float)meshlet.triangleCount;
+			next = NO_TRIANGLE;
+			GLuint bestExtra = 4;
+			float bestDistance = FLT_MAX;
+			for (size_t m = 0; m < members.size(); m++)
+			{
+				GLuint v = members[m];
+				for (GLuint j = adjacencyStart[v]; j < adjacencyStart[v + 1]; j++)
+				{
+					GLuint t = adjacency[j];
+					if (emitted[t])
+						continue;
+					const GLuint* candidate = &source[t * 3];
+					GLuint extra = 0;
+					for (int k = 0; k < 3; k++)
+						extra += meshletOf[candidate[k]] != id ? 1 : 0;
+					if (members.size() + extra > MESHLET_MAX_VERTICES)
+						continue;
+					glm::vec3 offset = triangleCentroid(shape, candidate) - centroid;
+					float distance = glm::dot(offset, offset);
+					if (extra < bestExtra || (extra == bestExtra && distance < bestDistance))
+					{
+						next = t;
+						bestExtra = extra;
+						bestDistance = distance;
+					}
+				}
+			}
+		}
+
+		meshlet.vertexCount = (GLuint)members.size();
+		computeBounds(shape, &indices[meshlet.firstIndex], members, meshlet);
+		meshlets.push_back(meshlet);
+	}
+	return meshlets;
+}
+
+void MeshletCuller::build(const ShapeData& shape, GLuint firstIndex, GLuint indexCount, bool cullBackFacing)
+{
+	meshlets = buildMeshlets(shape, firstIndex, indexCount, indices);
+	coneCulling = cullBackFacing;
+	indexType = shape.indexType;
+	visible.assign(meshlets.size(), 1);
+	streamOffsets.assign(meshlets.size(), 0);
+	visibleMeshlets = 0;
+	visibleIndices = 0;
+}
+
+void MeshletCuller::create()
+{
+	glGenBuffers(1, &streamBuffer);
+	// Every meshlet visible is the most the stream ever holds
+	streamCapacity = (GLsizeiptr)indices.size() * (indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, streamBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, streamCapacity, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void MeshletCuller::destroy()
+{
+	glDeleteBuffers(1, &streamBuffer);
+	streamBuffer = 0;
+	streamCapacity = 0;
+}
+
+void MeshletCuller::attach(GLuint vao) const
+{
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, streamBuffer);
+	glBindVertexArray(0);
+}
+
+GLuint MeshletCuller::cull(const glm::mat4& modelViewProjection, const glm::vec3& eye)
+{
+	// Meshlet bounds are in model space, so the planes are taken from the MVP
+	Frustum frustum = extractFrustum(modelViewProjection);
+
+	// Meshlets are tested in parallel, then packed into the stream in their original order
+	size_t count = meshlets.size();
+	ThreadPool& pool = ThreadPool::shared();
+	pool.parallelFor(count, 32, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const Meshlet& meshlet = meshlets[i];
+			bool inside = sphereInFrustum(frustum, meshlet.center, meshlet.radius);
+			bool backFacing = coneCulling && glm::dot(glm::normalize(meshlet.coneApex - eye), meshlet.coneAxis) >= meshlet.coneCutoff;
+			visible[i] = inside && !backFacing;
+		}
+	});
+
+	visibleMeshlets = 0;
+	visibleIndices = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!visible[i])
+			continue;
+		streamOffsets[i] = visibleIndices;
+		visibleIndices += meshlets[i].triangleCount * 3;
+		visibleMeshlets++;
+	}
+
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	stream.resize(visibleIndices * indexSize);
+	pool.parallelFor(count, 32, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!visible[i])
+				continue;
+			const Meshlet& meshlet = meshlets[i];
+			if (indexType == GL_UNSIGNED_INT)
+				copyMeshletIndices<GLuint>(&indices[meshlet.firstIndex], meshlet.triangleCount * 3, stream.data(), streamOffsets[i]);
+			else
+				copyMeshletIndices<GLushort>(&indices[meshlet.firstIndex], meshlet.triangleCount * 3, stream.data(), streamOffsets[i]);
+		}
+	});
+
+	// Uploaded through the copy target so no VAO's element binding is disturbed; orphaning
+	// keeps the upload from waiting on last frame's draw
+	glBindBuffer(GL_COPY_WRITE_BUFFER, streamBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, streamCapacity, NULL, GL_STREAM_DRAW);
+	if (visibleIndices > 0)
+		glBufferSubData(GL_COPY_WRITE_BUFFER, 0, stream.size(), stream.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return visibleIndices;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "ShapeData.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Sizes that also fit a mesh shader workgroup, should the renderer ever move to one
+const GLuint MESHLET_MAX_VERTICES = 64;
+const GLuint MESHLET_MAX_TRIANGLES = 124;
+
+// A small patch of connected triangles with the bounds used to cull it as a whole
+struct Meshlet
+{
+	GLuint firstIndex;      // into the meshlet-ordered index list
+	GLuint triangleCount;
+	GLuint vertexCount;
+	glm::vec3 center;       // bounding sphere
+	float radius;
+	// Every triangle faces away from an eye inside the cone at apex around -axis; it is
+	// back-facing when dot(normalize(apex - eye), axis) >= cutoff. A cutoff of 1 never culls.
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// Partitions [firstIndex, firstIndex + indexCount) into meshlets, growing each from a seed
+// triangle through its neighbours. indices receives the triangles in meshlet order, as
+// indices into the shape's vertex buffer.
+std::vector<Meshlet> buildMeshlets(const ShapeData& shape, GLuint firstIndex, GLuint indexCount, std::vector<GLuint>& indices);
+
+// Owns the meshlets of one index range and, each frame, rewrites a stream index buffer with
+// the triangles of the meshlets that can be visible so the range still draws in one call.
+class MeshletCuller
+{
+public:
+	MeshletCuller() : coneCulling(false), streamBuffer(0), streamCapacity(0), indexType(GL_UNSIGNED_SHORT), visibleMeshlets(0), visibleIndices(0) {}
+
+	// Cone culling drops meshlets that face away from the eye, which is only safe for closed
+	// meshes: the renderer never enables GL_CULL_FACE, so an open mesh shows its back faces.
+	void build(const ShapeData& shape, GLuint firstIndex, GLuint indexCount, bool cullBackFacing);
+	void create();
+	void destroy();
+	// Makes the stream buffer the element array of a VAO
+	void attach(GLuint vao) const;
+
+	// Culls against the frustum of modelViewProjection and, with cone culling on, against the
+	// normal cones as seen from eye, given in model space. The cone test assumes the model
+	// matrix does not shear or scale unevenly. Uploads the surviving indices and returns how
+	// many there are.
+	GLuint cull(const glm::mat4& modelViewProjection, const glm::vec3& eye);
+
+	GLenum streamIndexType() const { return indexType; }
+	GLuint meshletCount() const { return (GLuint)meshlets.size(); }
+	GLuint visibleMeshletCount() const { return visibleMeshlets; }
+	GLuint triangleCount() const { return (GLuint)indices.size() / 3; }
+	GLuint visibleTriangleCount() const { return visibleIndices / 3; }
+
+private:
+	std::vector<Meshlet> meshlets;
+	std::vector<GLuint> indices;
+	bool coneCulling;
+	std::vector<unsigned char> visible;   // per meshlet, from the last cull
+	std::vector<GLuint> streamOffsets;    // where each visible meshlet's indices start in the stream
+	std::vector<unsigned char> stream;
+	GLuint streamBuffer;
+	GLsizeiptr streamCapacity;
+	GLenum indexType;
+	GLuint visibleMeshlets;
+	GLuint visibleIndices;
+};
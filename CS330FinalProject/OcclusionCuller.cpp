@@ -0,0 +1,275 @@
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Tiles are rasterized in parallel, each by one thread over every triangle that overlaps it
+	const int TILE_WIDTH = 64;
+	const int TILE_HEIGHT = 32;
+	const float MIN_CLIP_W = 1e-5f;
+	const GLuint NO_VERTEX = 0xffffffffu;
+
+	// Coefficients of a * x + b * y + c, positive on the inner side of the edge from p to q
+	struct Edge
+	{
+		float a, b, c;
+	};
+
+	Edge makeEdge(float px, float py, float qx, float qy)
+	{
+		Edge edge;
+		edge.a = py - qy;
+		edge.b = qx - px;
+		edge.c = -edge.a * px - edge.b * py;
+		return edge;
+	}
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+OcclusionCuller::OcclusionCuller() : culled(0), milliseconds(0.0)
+{
+	int width = OCCLUSION_WIDTH, height = OCCLUSION_HEIGHT;
+	for (;;)
+	{
+		levels.push_back(std::vector<float>(width * height, 1.0f));
+		levelWidths.push_back(width);
+		levelHeights.push_back(height);
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(1, (width + 1) / 2);
+		height = std::max(1, (height + 1) / 2);
+	}
+}
+
+void OcclusionCuller::addOccluder(const ShapeData& shape, GLuint firstIndex, GLuint indexCount, const glm::mat4& transform)
+{
+	// Only the vertices the range uses are kept
+	std::vector<GLuint> remap(shape.numVertices, NO_VERTEX);
+	for (GLuint i = firstIndex; i < firstIndex + indexCount; i++)
+	{
+		GLuint v = shape.index(i);
+		if (remap[v] == NO_VERTEX)
+		{
+			remap[v] = (GLuint)positions.size();
+			positions.push_back(glm::vec3(transform * glm::vec4(shape.vertices[v].position, 1.0f)));
+		}
+		triangles.push_back(remap[v]);
+	}
+	screen.resize(positions.size());
+}
+
+void OcclusionCuller::rasterize(const glm::mat4& clipFromOccluder)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ThreadPool& pool = ThreadPool::shared();
+
+	pool.parallelFor(positions.size(), 256, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::vec4 clip = clipFromOccluder * glm::vec4(positions[i], 1.0f);
+			ScreenVertex& out = screen[i];
+			out.clipped = clip.w <= MIN_CLIP_W || clip.z < -clip.w;
+			if (out.clipped)
+				continue;
+			float invW = 1.0f / clip.w;
+			out.x = (clip.x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+			out.y = (clip.y * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+			out.z = clip.z * invW * 0.5f + 0.5f;
+		}
+	});
+
+	int tilesX = (OCCLUSION_WIDTH + TILE_WIDTH - 1) / TILE_WIDTH;
+	int tilesY = (OCCLUSION_HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	pool.parallelFor(tilesX * tilesY, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t tile = begin; tile < end; tile++)
+			rasterizeTile((int)tile % tilesX, (int)tile / tilesX);
+	});
+
+	buildPyramid();
+	culled = 0;
+	milliseconds = millisecondsSince(start);
+}
+
+void OcclusionCuller::rasterizeTile(int tileX, int tileY)
+{
+	int x0 = tileX * TILE_WIDTH, x1 = std::min(x0 + TILE_WIDTH, OCCLUSION_WIDTH);
+	int y0 = tileY * TILE_HEIGHT, y1 = std::min(y0 + TILE_HEIGHT, OCCLUSION_HEIGHT);
+	std::vector<float>& depth = levels[0];
+	for (int y = y0; y < y1; y++)
+		std::fill(depth.begin() + y * OCCLUSION_WIDTH + x0, depth.begin() + y * OCCLUSION_WIDTH + x1, 1.0f);
+
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+	{
+		const ScreenVertex* v0 = &screen[triangles[t]];
+		const ScreenVertex* v1 = &screen[triangles[t + 1]];
+		const ScreenVertex* v2 = &screen[triangles[t + 2]];
+		if (v0->clipped || v1->clipped || v2->clipped)
+			continue;
+
+		// Occluders are drawn two-sided, so clockwise triangles are flipped rather than skipped
+		float area = (v1->x - v0->x) * (v2->y - v0->y) - (v2->x - v0->x) * (v1->y - v0->y);
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+		if (area < 1e-6f)
+			continue;
+
+		// Pixels whose centres fall in the triangle's box, clipped to the tile
+		int minX = std::max(x0, (int)ceilf(std::min(v0->x, std::min(v1->x, v2->x)) - 0.5f));
+		int maxX = std::min(x1 - 1, (int)floorf(std::max(v0->x, std::max(v1->x, v2->x)) - 0.5f));
+		int minY = std::max(y0, (int)ceilf(std::min(v0->y, std::min(v1->y, v2->y)) - 0.5f));
+		int maxY = std::min(y1 - 1, (int)floorf(std::max(v0->y, std::max(v1->y, v2->y)) - 0.5f));
+		if (minX > maxX || minY > maxY)
+			continue;
+
+		// e12 weights v0, e20 weights v1 and e01 weights v2; depth is a plane in screen space
+		Edge e12 = makeEdge(v1->x, v1->y, v2->x, v2->y);
+		Edge e20 = makeEdge(v2->x, v2->y, v0->x, v0->y);
+		Edge e01 = makeEdge(v0->x, v0->y, v1->x, v1->y);
+		float invArea = 1.0f / area;
+		float dz1 = (v1->z - v0->z) * invArea, dz2 = (v2->z - v0->z) * invArea;
+		float za = e20.a * dz1 + e01.a * dz2;
+		float zb = e20.b * dz1 + e01.b * dz2;
+		float zc = v0->z + e20.c * dz1 + e01.c * dz2;
+
+		// Spans start on a multiple of 4 so every group of 4 stays inside the tile
+		minX &= ~3;
+		for (int y = minY; y <= maxY; y++)
+		{
+			float* row = &depth[y * OCCLUSION_WIDTH];
+			float py = y + 0.5f;
+			int x = minX;
+#ifdef OCCLUSION_SSE
+			const __m128 zero = _mm_setzero_ps();
+			__m128 rowW0 = _mm_set1_ps(e12.b * py + e12.c), rowW1 = _mm_set1_ps(e20.b * py + e20.c), rowW2 = _mm_set1_ps(e01.b * py + e01.c);
+			__m128 rowZ = _mm_set1_ps(zb * py + zc);
+			for (; x <= maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+				__m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e12.a), px), rowW0);
+				__m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e20.a), px), rowW1);
+				__m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e01.a), px), rowW2);
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+				__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), rowZ);
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 write = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(write, z), _mm_andnot_ps(write, old)));
+			}
+#endif
+			for (; x <= maxX; x++)
+			{
+				float px = x + 0.5f;
+				if (e12.a * px + e12.b * py + e12.c < 0.0f || e20.a * px + e20.b * py + e20.c < 0.0f || e01.a * px + e01.b * py + e01.c < 0.0f)
+					continue;
+				float z = za * px + zb * py + zc;
+				if (z < row[x])
+					row[x] = z;
+			}
+		}
+	}
+}
+
+void OcclusionCuller::buildPyramid()
+{
+	// Each texel keeps the farthest depth of the 2x2 below it, so a box nearer than a texel is
+	// in front of everything drawn there
+	for (size_t level = 1; level < levels.size(); level++)
+	{
+		const std::vector<float>& fine = levels[level - 1];
+		std::vector<float>& coarse = levels[level];
+		int fineWidth = levelWidths[level - 1], fineHeight = levelHeights[level - 1];
+		int width = levelWidths[level];
+		ThreadPool::shared().parallelFor(levelHeights[level], 16, [&](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; y++)
+			{
+				int fy0 = (int)y * 2, fy1 = std::min(fy0 + 1, fineHeight - 1);
+				for (int x = 0; x < width; x++)
+				{
+					int fx0 = x * 2, fx1 = std::min(fx0 + 1, fineWidth - 1);
+					coarse[y * width + x] = std::max(
+						std::max(fine[fy0 * fineWidth + fx0], fine[fy0 * fineWidth + fx1]),
+						std::max(fine[fy1 * fineWidth + fx0], fine[fy1 * fineWidth + fx1]));
+				}
+			}
+		});
+	}
+}
+
+bool OcclusionCuller::boxVisible(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	float minX = (float)OCCLUSION_WIDTH, maxX = 0.0f, minY = (float)OCCLUSION_HEIGHT, maxY = 0.0f, minZ = 1.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 p((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+		glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+		// A box reaching the near plane covers the eye's view, so it cannot be proven hidden
+		if (clip.w <= MIN_CLIP_W || clip.z < -clip.w)
+			return true;
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (clip.y * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z * invW * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(0, (int)floorf(minX)), x1 = std::min(OCCLUSION_WIDTH - 1, (int)floorf(maxX));
+	int y0 = std::max(0, (int)floorf(minY)), y1 = std::min(OCCLUSION_HEIGHT - 1, (int)floorf(maxY));
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	// Coarsest level where the box spans at most 2x2 texels
+	size_t level = 0;
+	while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+		level++;
+	const std::vector<float>& texels = levels[level];
+	int width = levelWidths[level];
+	float farthest = 0.0f;
+	for (int y = y0 >> level; y <= y1 >> level; y++)
+	{
+		for (int x = x0 >> level; x <= x1 >> level; x++)
+			farthest = std::max(farthest, texels[y * width + x]);
+	}
+	return minZ <= farthest;
+}
+
+size_t OcclusionCuller::cullBoxes(const glm::mat4& viewProjection, const BoundingVolume* boxes, size_t count, unsigned char* visible)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::atomic<size_t> hidden(0);
+	ThreadPool::shared().parallelFor(count, 64, [&](size_t begin, size_t end)
+	{
+		size_t chunkHidden = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!visible[i] || boxVisible(viewProjection, boxes[i].boxMin, boxes[i].boxMax))
+				continue;
+			visible[i] = 0;
+			chunkHidden++;
+		}
+		hidden += chunkHidden;
+	});
+	culled += hidden;
+	milliseconds += millisecondsSince(start);
+	return hidden;
+}
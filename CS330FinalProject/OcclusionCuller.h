@@ -0,0 +1,56 @@
+#pragma once
+#include "ShapeData.h"
+#include "BoundingVolume.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Resolution of the software depth buffer; the width is a multiple of 4 for the SSE span loop
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+
+// Rasterizes a few large occluders into a small depth buffer on the CPU, reduces it to a
+// hierarchical (max depth) pyramid and rejects boxes that lie entirely behind it. Nothing
+// here touches the GPU, so it runs the same without a context.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	// Copies the triangles of [firstIndex, firstIndex + indexCount), moved by transform into
+	// the space the clip matrix of rasterize() maps from. Occluders must be solid: anything
+	// drawn here hides what is behind it.
+	void addOccluder(const ShapeData& shape, GLuint firstIndex, GLuint indexCount, const glm::mat4& transform);
+
+	// Draws every occluder with clipFromOccluder and rebuilds the pyramid. Triangles that
+	// cross the near plane are dropped, which only ever lets more through.
+	void rasterize(const glm::mat4& clipFromOccluder);
+
+	// World-space boxes against the last rasterize(), with viewProjection mapping world space
+	// to the same clip space. Entries of visible that are already 0 are skipped; occluded
+	// ones are set to 0. Returns how many this call culled.
+	size_t cullBoxes(const glm::mat4& viewProjection, const BoundingVolume* boxes, size_t count, unsigned char* visible);
+	bool boxVisible(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+	size_t occluderTriangleCount() const { return triangles.size() / 3; }
+	// Totals since the last rasterize()
+	size_t culledCount() const { return culled; }
+	double passMilliseconds() const { return milliseconds; }
+
+private:
+	struct ScreenVertex
+	{
+		float x, y, z;  // pixels and [0, 1] depth
+		bool clipped;   // on or behind the near plane
+	};
+
+	void rasterizeTile(int tileX, int tileY);
+	void buildPyramid();
+
+	std::vector<glm::vec3> positions;
+	std::vector<GLuint> triangles;
+	std::vector<ScreenVertex> screen;
+	std::vector<std::vector<float> > levels; // levels[0] is the depth buffer, each next one half the size
+	std::vector<int> levelWidths, levelHeights;
+	size_t culled;
+	double milliseconds;
+};
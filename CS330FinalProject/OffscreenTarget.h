@@ -0,0 +1,26 @@
+#pragma once
+#include <GL/glew.h>
+
+// Framebuffer object with an RGBA8 color and a 24-bit depth renderbuffer, for rendering at
+// any resolution without a window surface
+class OffscreenTarget
+{
+public:
+	OffscreenTarget() : framebuffer(0), colorBuffer(0), depthBuffer(0), targetWidth(0), targetHeight(0) {}
+
+	bool create(int width, int height);
+	void destroy();
+
+	// Makes it the draw and read framebuffer and sets the viewport to cover it
+	void bind() const;
+
+	int width() const { return targetWidth; }
+	int height() const { return targetHeight; }
+
+private:
+	GLuint framebuffer;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+	int targetWidth;
+	int targetHeight;
+};
@@ -0,0 +1,192 @@
+#include "PackedVertex.h"
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+namespace
+{
+	inline float clampf(float value, float low, float high)
+	{
+		return value < low ? low : (value > high ? high : value);
+	}
+
+	inline float signNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	inline GLshort toSnorm16(float value)
+	{
+		return (GLshort)lroundf(clampf(value, -1.0f, 1.0f) * 32767.0f);
+	}
+
+	inline float fromSnorm16(GLshort value)
+	{
+		float f = value / 32767.0f;
+		return f < -1.0f ? -1.0f : f;
+	}
+}
+
+glm::mat4 QuantizationBounds::decodeMatrix() const
+{
+	glm::mat4 decode(1.0f);
+	decode[0][0] = extent.x;
+	decode[1][1] = extent.y;
+	decode[2][2] = extent.z;
+	decode[3] = glm::vec4(origin, 1.0f);
+	return decode;
+}
+
+QuantizationBounds computeQuantizationBounds(const Vertex* vertices, GLuint count)
+{
+	glm::vec3 low(0.0f), high(0.0f);
+	if (count > 0)
+		low = high = vertices[0].position;
+	for (GLuint i = 1; i < count; i++)
+	{
+		low = glm::min(low, vertices[i].position);
+		high = glm::max(high, vertices[i].position);
+	}
+
+	QuantizationBounds bounds;
+	bounds.origin = low;
+	bounds.extent = high - low;
+	// A flat axis still needs a non-zero scale to divide by
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (bounds.extent[axis] <= 0.0f)
+			bounds.extent[axis] = 1.0f;
+	}
+	return bounds;
+}
+
+glm::vec2 octahedralEncode(const glm::vec3& normal)
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper
+	float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (l1 <= 0.0f)
+		return glm::vec2(0.0f);
+	glm::vec2 encoded(normal.x / l1, normal.y / l1);
+	if (normal.z < 0.0f)
+	{
+		encoded = glm::vec2(
+			(1.0f - fabsf(encoded.y)) * signNotZero(encoded.x),
+			(1.0f - fabsf(encoded.x)) * signNotZero(encoded.y));
+	}
+	return encoded;
+}
+
+glm::vec3 octahedralDecode(const glm::vec2& encoded)
+{
+	glm::vec3 n(encoded.x, encoded.y, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+	if (n.z < 0.0f)
+	{
+		float x = n.x;
+		n.x = (1.0f - fabsf(n.y)) * signNotZero(x);
+		n.y = (1.0f - fabsf(x)) * signNotZero(n.y);
+	}
+	return glm::normalize(n);
+}
+
+GLushort floatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	GLushort sign = (GLushort)((bits >> 16) & 0x8000);
+	unsigned int mantissa = bits & 0x007fffff;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+
+	// Infinity and NaN keep their class
+	if ((bits & 0x7fffffff) >= 0x7f800000)
+		return sign | 0x7c00 | (mantissa ? 0x0200 : 0);
+	if (exponent >= 31)
+		return sign | 0x7c00;
+
+	if (exponent <= 0)
+	{
+		// Subnormal half, or zero when even the subnormals cannot hold it
+		if (exponent < -10)
+			return sign;
+		mantissa |= 0x00800000;
+		int shift = 14 - exponent;
+		GLushort half = (GLushort)(mantissa >> shift);
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return sign | half;
+	}
+
+	// Rounding may carry into the exponent, which is the correct result
+	GLushort half = (GLushort)(sign | (exponent << 10) | (mantissa >> 13));
+	if (mantissa & 0x00001000)
+		half++;
+	return half;
+}
+
+float halfToFloat(GLushort half)
+{
+	unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+	unsigned int exponent = (half >> 10) & 0x1f;
+	unsigned int mantissa = half & 0x03ff;
+
+	if (exponent == 0)
+	{
+		float magnitude = ldexpf((float)mantissa, -24);
+		return sign ? -magnitude : magnitude;
+	}
+
+	unsigned int bits;
+	if (exponent == 31)
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+PackedVertex encodeVertex(const Vertex& vertex, const QuantizationBounds& bounds)
+{
+	PackedVertex packed;
+	glm::vec3 relative = (vertex.position - bounds.origin) / bounds.extent;
+	for (int axis = 0; axis < 3; axis++)
+		packed.position[axis] = (GLushort)lroundf(clampf(relative[axis], 0.0f, 1.0f) * 65535.0f);
+	packed.position[3] = 0;
+
+	glm::vec2 octahedral = octahedralEncode(vertex.normal);
+	packed.normal[0] = toSnorm16(octahedral.x);
+	packed.normal[1] = toSnorm16(octahedral.y);
+
+	packed.uv[0] = floatToHalf(vertex.uv.x);
+	packed.uv[1] = floatToHalf(vertex.uv.y);
+	return packed;
+}
+
+Vertex decodeVertex(const PackedVertex& packed, const QuantizationBounds& bounds)
+{
+	Vertex vertex;
+	glm::vec3 relative(packed.position[0], packed.position[1], packed.position[2]);
+	vertex.position = bounds.origin + relative / 65535.0f * bounds.extent;
+	vertex.normal = octahedralDecode(glm::vec2(fromSnorm16(packed.normal[0]), fromSnorm16(packed.normal[1])));
+	vertex.uv = glm::vec2(halfToFloat(packed.uv[0]), halfToFloat(packed.uv[1]));
+	vertex.color = glm::vec3(1.0f);   // Not packed
+	return vertex;
+}
+
+void packVertices(const Vertex* vertices, GLuint count, const QuantizationBounds& bounds, PackedVertex* out)
+{
+	for (GLuint i = 0; i < count; i++)
+		out[i] = encodeVertex(vertices[i], bounds);
+}
+
+void setupPackedVertexAttributes(GLintptr baseOffset)
+{
+	const GLsizei stride = sizeof(PackedVertex);
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(baseOffset + offsetof(PackedVertex, position)));
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)(baseOffset + offsetof(PackedVertex, normal)));
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(baseOffset + offsetof(PackedVertex, uv)));
+	glEnableVertexAttribArray(2);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+// 16-byte GPU vertex, against 44 bytes for Vertex:
+//  position - unsigned normalized 16-bit, relative to the mesh bounds (w is padding)
+//  normal   - octahedral encoding in two signed normalized 16-bit values
+//  uv       - half floats
+// Vertex colors are left out: no shader reads them, objects are tinted by ObjectTransform.color.
+struct PackedVertex
+{
+	GLushort position[4];
+	GLshort normal[2];
+	GLushort uv[2];
+};
+
+// Box that 16-bit positions are normalized against
+struct QuantizationBounds
+{
+	glm::vec3 origin;
+	glm::vec3 extent;
+
+	// Maps the 0..1 values the vertex shader reads back to mesh space; fold into the model matrix
+	glm::mat4 decodeMatrix() const;
+};
+
+QuantizationBounds computeQuantizationBounds(const Vertex* vertices, GLuint count);
+
+PackedVertex encodeVertex(const Vertex& vertex, const QuantizationBounds& bounds);
+Vertex decodeVertex(const PackedVertex& packed, const QuantizationBounds& bounds);
+void packVertices(const Vertex* vertices, GLuint count, const QuantizationBounds& bounds, PackedVertex* out);
+
+// Unit vector <-> octahedral coordinates in [-1, 1]^2
+glm::vec2 octahedralEncode(const glm::vec3& normal);
+glm::vec3 octahedralDecode(const glm::vec2& encoded);
+
+GLushort floatToHalf(float value);
+float halfToFloat(GLushort half);
+
+// Points attributes 0-2 of the bound VAO at packed vertices in the bound array buffer
+void setupPackedVertexAttributes(GLintptr baseOffset = 0);
@@ -0,0 +1,167 @@
+#include "ProgramBuilder.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Same value for the KHR and ARB versions of the extension
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace
+{
+	bool hasExtension(const char* name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension && strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+void ProgramBuilder::create(ProgramCache* programCache)
+{
+	cache = programCache;
+
+	// As many compiler threads as the driver allows; the KHR entry point is preferred, the ARB
+	// one behaves the same
+	parallelCompile = false;
+#ifdef GL_KHR_parallel_shader_compile
+	if (!parallelCompile && hasExtension("GL_KHR_parallel_shader_compile") && glMaxShaderCompilerThreadsKHR)
+	{
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		parallelCompile = true;
+	}
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+	if (!parallelCompile && hasExtension("GL_ARB_parallel_shader_compile") && glMaxShaderCompilerThreadsARB)
+	{
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		parallelCompile = true;
+	}
+#endif
+}
+
+// The defines go after the #version line, which has to stay first
+GLuint ProgramBuilder::compile(GLenum type, const char* source, const char* defines)
+{
+	const char* body = strchr(source, '\n');
+	body = body ? body + 1 : source + strlen(source);
+	const GLchar* parts[] = { source, defines, body };
+	GLint lengths[] = { (GLint)(body - source), -1, -1 };
+
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 3, parts, lengths);
+	glCompileShader(shader);
+	return shader;
+}
+
+GLuint ProgramBuilder::submit(const char* vertexSource, const char* fragmentSource, const char* defines)
+{
+	Build build = {};
+	if (cache)
+	{
+		build.cacheKey = cache->key(vertexSource, fragmentSource, defines);
+		build.program = cache->load(build.cacheKey);
+	}
+	if (build.program)
+	{
+		build.cached = true;
+		build.complete = true;
+		builds.push_back(build);
+		return build.program;
+	}
+
+	// Linked straight away without looking at the compiles: a failed compile fails the link,
+	// and finish() reports which stage it was
+	build.program = glCreateProgram();
+	build.vertexShader = compile(GL_VERTEX_SHADER, vertexSource, defines);
+	build.fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentSource, defines);
+	glAttachShader(build.program, build.vertexShader);
+	glAttachShader(build.program, build.fragmentShader);
+	glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(build.program);
+	builds.push_back(build);
+	return build.program;
+}
+
+int ProgramBuilder::poll()
+{
+	int pending = 0;
+	for (Build& build : builds)
+	{
+		if (!build.complete && parallelCompile)
+		{
+			GLint complete = GL_FALSE;
+			glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+			build.complete = complete == GL_TRUE;
+		}
+		if (!build.complete)
+			pending++;
+	}
+	return pending;
+}
+
+bool ProgramBuilder::reportCompile(GLuint shader, const char* stage)
+{
+	GLint success = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (success)
+		return true;
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	std::string log(length > 0 ? length : 1, '\0');
+	glGetShaderInfoLog(shader, (GLsizei)log.size(), NULL, &log[0]);
+	std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n" << log.c_str() << std::endl;
+	return false;
+}
+
+bool ProgramBuilder::finish()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok = true;
+	for (Build& build : builds)
+	{
+		if (build.cached)
+			continue;
+
+		// Blocks until the driver is done with this program
+		GLint linked = 0;
+		glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+		if (linked)
+		{
+			if (cache && cache->isEnabled() && !cache->store(build.cacheKey, build.program))
+				std::cout << "WARNING: Could not cache the program binary" << std::endl;
+		}
+		else
+		{
+			// A shader that failed to compile explains the link failure better than the link log
+			bool compiled = reportCompile(build.vertexShader, "VERTEX");
+			compiled = reportCompile(build.fragmentShader, "FRAGMENT") && compiled;
+			if (compiled)
+			{
+				GLint length = 0;
+				glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &length);
+				std::string log(length > 0 ? length : 1, '\0');
+				glGetProgramInfoLog(build.program, (GLsizei)log.size(), NULL, &log[0]);
+				std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << log.c_str() << std::endl;
+			}
+			ok = false;
+		}
+
+		// The linked program keeps its own copy of the code
+		glDetachShader(build.program, build.vertexShader);
+		glDetachShader(build.program, build.fragmentShader);
+		glDeleteShader(build.vertexShader);
+		glDeleteShader(build.fragmentShader);
+	}
+	builds.clear();
+	waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
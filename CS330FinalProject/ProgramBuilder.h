@@ -0,0 +1,53 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+#include "ProgramCache.h"
+
+// Builds every shader program of a launch together instead of one after another. submit()
+// issues both compiles and the link and returns at once; with KHR_parallel_shader_compile the
+// driver works through them on its own threads while the caller loads assets, and poll() asks
+// GL_COMPLETION_STATUS_KHR without waiting. Compile and link status and the logs are only read
+// in finish(), since querying them any earlier blocks until the driver is done. Programs the
+// ProgramCache already holds skip the compiler entirely.
+class ProgramBuilder
+{
+public:
+	ProgramBuilder() : cache(0), parallelCompile(false), waitSeconds(0.0) {}
+
+	// Starts the driver's compiler threads when it has them; cache may be null
+	void create(ProgramCache* programCache);
+
+	// The program's id, usable once finish() succeeds. Defines are whole #define lines placed
+	// after each source's #version line.
+	GLuint submit(const char* vertexSource, const char* fragmentSource, const char* defines = "");
+	// Submitted programs the driver is still compiling or linking. Without the extension the
+	// answer is unknowable without blocking, so everything counts as pending.
+	int poll();
+	// Waits for every submitted program, prints the logs of any that failed and caches the new
+	// ones; false if any failed
+	bool finish();
+
+	bool isParallel() const { return parallelCompile; }
+	// Time finish() spent waiting on the driver
+	double waitMilliseconds() const { return waitSeconds * 1000.0; }
+
+private:
+	struct Build
+	{
+		GLuint program;
+		GLuint vertexShader;
+		GLuint fragmentShader;
+		uint64_t cacheKey;
+		bool cached;            // Restored from a binary, nothing to wait for
+		bool complete;          // Seen complete by poll()
+	};
+
+	static GLuint compile(GLenum type, const char* source, const char* defines);
+	static bool reportCompile(GLuint shader, const char* stage);
+
+	ProgramCache* cache;
+	bool parallelCompile;
+	std::vector<Build> builds;
+	double waitSeconds;
+};
@@ -0,0 +1,120 @@
+#include "ProgramCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+	const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'G', 'B' };
+
+	// FNV-1a, continued from hash. The terminator is hashed too, so ("ab", "c") and ("a", "bc")
+	// give different keys.
+	uint64_t hashString(uint64_t hash, const char* text)
+	{
+		const char* c = text ? text : "";
+		do
+		{
+			hash ^= (unsigned char)*c;
+			hash *= 1099511628211ull;
+		} while (*c++);
+		return hash;
+	}
+}
+
+void ProgramCache::create(const char* pathPrefix)
+{
+	prefix = pathPrefix;
+	driverHash = 14695981039346656037ull;
+	driverHash = hashString(driverHash, (const char*)glGetString(GL_VENDOR));
+	driverHash = hashString(driverHash, (const char*)glGetString(GL_RENDERER));
+	driverHash = hashString(driverHash, (const char*)glGetString(GL_VERSION));
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	enabled = formats > 0;
+}
+
+uint64_t ProgramCache::key(const char* vertexSource, const char* fragmentSource, const char* defines) const
+{
+	uint64_t hash = hashString(driverHash, defines);
+	hash = hashString(hash, vertexSource);
+	return hashString(hash, fragmentSource);
+}
+
+std::string ProgramCache::path(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return prefix + name + ".programcache";
+}
+
+GLuint ProgramCache::load(uint64_t key)
+{
+	if (!enabled)
+		return 0;
+
+	std::ifstream in(path(key).c_str(), std::ios::binary);
+	ProgramCacheHeader header;
+	if (!in || !in.read((char*)&header, sizeof(header)) || memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != PROGRAM_CACHE_VERSION || header.key != key || header.binaryLength == 0)
+	{
+		misses++;
+		return 0;
+	}
+	std::vector<char> binary(header.binaryLength);
+	if (!in.read(binary.data(), (std::streamsize)binary.size()))
+	{
+		misses++;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, (GLenum)header.binaryFormat, binary.data(), (GLsizei)binary.size());
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		glDeleteProgram(program);
+		misses++;
+		rejected++;
+		return 0;
+	}
+	hits++;
+	return program;
+}
+
+bool ProgramCache::store(uint64_t key, GLuint program)
+{
+	if (!enabled)
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return false;
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	header.binaryFormat = format;
+	header.binaryLength = (uint32_t)written;
+
+	std::ofstream out(path(key).c_str(), std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+	out.write((const char*)&header, sizeof(header));
+	out.write(binary.data(), written);
+	if (!out.flush())
+		return false;
+	stored++;
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+
+// Bumped whenever the file layout changes; older files are then ignored and rewritten
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// A cache file is this header followed by binaryLength bytes from glGetProgramBinary
+struct ProgramCacheHeader
+{
+	char magic[4];          // "PRGB"
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t binaryLength;
+};
+
+// Linked program binaries on disk, one file per program, so later launches skip compiling and
+// linking. A key covers the sources, the defines and the driver's vendor, renderer and version
+// strings: editing a shader or updating the driver just misses and links from source again.
+// Drivers may still refuse a binary they wrote, which also counts as a miss.
+class ProgramCache
+{
+public:
+	ProgramCache() : enabled(false), driverHash(0), hits(0), misses(0), rejected(0), stored(0) {}
+
+	// Reads the driver identity; files are written as <pathPrefix><key>.programcache. The
+	// cache stays off when the driver offers no binary formats.
+	void create(const char* pathPrefix);
+
+	uint64_t key(const char* vertexSource, const char* fragmentSource, const char* defines) const;
+	// A linked program restored from the cache, or 0 on a miss
+	GLuint load(uint64_t key);
+	// Saves a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	bool store(uint64_t key, GLuint program);
+
+	bool isEnabled() const { return enabled; }
+	int hitCount() const { return hits; }
+	int missCount() const { return misses; }
+	int rejectedCount() const { return rejected; }
+	int storedCount() const { return stored; }
+
+private:
+	std::string path(uint64_t key) const;
+
+	bool enabled;
+	std::string prefix;
+	uint64_t driverHash;
+	int hits;
+	int misses;
+	int rejected;           // Misses where a file existed but the driver refused its binary
+	int stored;
+};
@@ -0,0 +1,125 @@
+#include "RenderQueue.h"
+
+uint64_t makeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth)
+{
+	const uint32_t depthMax = (1u << 24) - 1;
+	float clamped = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+	uint32_t depthBits = (uint32_t)(clamped * depthMax);
+	if (pass == RENDER_PASS_TRANSPARENT)
+		depthBits = depthMax - depthBits;
+	return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(program & 0xFFF) << 48) | ((uint64_t)(texture & 0xFFF) << 36)
+		| ((uint64_t)(vao & 0xFFF) << 24) | depthBits;
+}
+
+RenderItem makeElementsItem(GLuint program, GLuint texture, GLuint vao, GLenum indexType, GLsizei count, const void* indices,
+	GLsizei instanceCount, GLint baseVertex, GLuint baseInstance)
+{
+	RenderItem item = { program, texture, vao, indexType, count, indices, instanceCount, baseVertex, baseInstance, 0, 0, false };
+	return item;
+}
+
+RenderItem makeIndirectItem(GLuint program, GLuint texture, GLuint vao, GLenum indexType, const IndirectDrawBuffer& indirect, GLuint run,
+	bool multiDraw)
+{
+	RenderItem item = { program, texture, vao, indexType, 0, 0, 0, 0, 0, &indirect, run, multiDraw };
+	return item;
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	keys.clear();
+}
+
+void RenderQueue::add(uint64_t key, const RenderItem& item)
+{
+	items.push_back(item);
+	keys.push_back(key);
+}
+
+// LSD radix sort over the key bytes, stable so equal keys keep their submission order.
+// Bytes every key shares, such as the pass and the unused high name bits, are skipped.
+void RenderQueue::sort()
+{
+	size_t count = keys.size();
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+	sortKeys.assign(keys.begin(), keys.end());
+	scratchKeys.resize(count);
+	scratchOrder.resize(count);
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (size_t i = 0; i < count; i++)
+			histogram[(sortKeys[i] >> shift) & 0xFF]++;
+		if (count == 0 || histogram[(sortKeys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			size_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t slot = histogram[(sortKeys[i] >> shift) & 0xFF]++;
+			scratchKeys[slot] = sortKeys[i];
+			scratchOrder[slot] = order[i];
+		}
+		sortKeys.swap(scratchKeys);
+		order.swap(scratchOrder);
+	}
+}
+
+void RenderQueue::submit()
+{
+	programStats = BindStats();
+	textureStats = BindStats();
+	vaoStats = BindStats();
+
+	// Nothing is assumed bound at the start of a frame
+	GLuint program = ~0u, texture = ~0u, vao = ~0u;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const RenderItem& item = items[order[i]];
+		if (item.program != program)
+		{
+			glUseProgram(item.program);
+			program = item.program;
+			programStats.issued++;
+		}
+		else
+			programStats.skipped++;
+
+		if (item.texture != 0 && item.texture != texture)
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, item.texture);
+			texture = item.texture;
+			textureStats.issued++;
+		}
+		else if (item.texture != 0)
+			textureStats.skipped++;
+
+		if (item.vao != vao)
+		{
+			glBindVertexArray(item.vao);
+			vao = item.vao;
+			vaoStats.issued++;
+		}
+		else
+			vaoStats.skipped++;
+
+		if (item.indirect && item.multiDraw)
+			item.indirect->draw(item.run, item.indexType);
+		else if (item.indirect)
+			item.indirect->drawDirect(item.run, item.indexType);
+		else
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, item.count, item.indexType, item.indices, item.instanceCount,
+				item.baseVertex, item.baseInstance);
+	}
+}
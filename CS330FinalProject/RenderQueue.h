@@ -0,0 +1,75 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+#include "IndirectDraws.h"
+
+// Passes run in this order; opaque items sort front to back, transparent ones back to front
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE = 0,
+	RENDER_PASS_TRANSPARENT = 1
+};
+
+// Sort key, most significant field first: pass (4 bits), program, texture and VAO (12 bits
+// each) and depth (24 bits). GL names are masked into their fields; the key only orders the
+// items, and state is bound from the items themselves, so a collision costs a bind at worst.
+uint64_t makeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth);
+
+// One draw and the state it needs. Either an indexed draw, or a run of indirect commands
+// when indirect is set.
+struct RenderItem
+{
+	GLuint program;
+	GLuint texture;         // Bound to unit 0; 0 leaves the bound texture alone
+	GLuint vao;
+	GLenum indexType;
+	GLsizei count;
+	const void* indices;
+	GLsizei instanceCount;
+	GLint baseVertex;
+	GLuint baseInstance;
+	const IndirectDrawBuffer* indirect;
+	GLuint run;
+	bool multiDraw;         // One glMultiDrawElementsIndirect for the run, or one call per command
+};
+
+RenderItem makeElementsItem(GLuint program, GLuint texture, GLuint vao, GLenum indexType, GLsizei count, const void* indices,
+	GLsizei instanceCount, GLint baseVertex, GLuint baseInstance);
+RenderItem makeIndirectItem(GLuint program, GLuint texture, GLuint vao, GLenum indexType, const IndirectDrawBuffer& indirect, GLuint run,
+	bool multiDraw);
+
+// Collects a frame's draws, radix sorts them by key and submits them, binding a program,
+// texture or VAO only when it differs from the one already bound
+class RenderQueue
+{
+public:
+	struct BindStats
+	{
+		unsigned int issued;
+		unsigned int skipped;
+	};
+
+	void clear();
+	void add(uint64_t key, const RenderItem& item);
+	void sort();
+	// Leaves the last item's program and VAO bound
+	void submit();
+
+	GLuint size() const { return (GLuint)items.size(); }
+	// Counters of the last submit()
+	const BindStats& programBinds() const { return programStats; }
+	const BindStats& textureBinds() const { return textureStats; }
+	const BindStats& vaoBinds() const { return vaoStats; }
+
+private:
+	std::vector<RenderItem> items;
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;        // item indices in key order once sorted
+	std::vector<uint64_t> sortKeys;     // radix sort buffers
+	std::vector<uint64_t> scratchKeys;
+	std::vector<uint32_t> scratchOrder;
+	BindStats programStats;
+	BindStats textureStats;
+	BindStats vaoStats;
+};
@@ -0,0 +1,143 @@
+#include "ShaderProgram.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <cstring>
+
+namespace
+{
+	// Bytes needed to shadow one element of a reflected uniform type
+	GLuint uniformTypeSize(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT_VEC2: return 2 * sizeof(GLfloat);
+		case GL_FLOAT_VEC3: return 3 * sizeof(GLfloat);
+		case GL_FLOAT_VEC4: return 4 * sizeof(GLfloat);
+		case GL_FLOAT_MAT3: return 9 * sizeof(GLfloat);
+		case GL_FLOAT_MAT4: return 16 * sizeof(GLfloat);
+		default: return sizeof(GLint); // scalars, bools and samplers
+		}
+	}
+
+	bool isIntegerType(GLenum type)
+	{
+		return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE;
+	}
+}
+
+bool ShaderProgram::reflect(GLuint program)
+{
+	programId = program;
+	uniforms.clear();
+	shadow.clear();
+
+	GLint count = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	if (count <= 0)
+		return false;
+
+	std::vector<GLchar> name(maxNameLength > 0 ? maxNameLength : 1);
+	GLuint offset = 0;
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(programId, (GLuint)i, maxNameLength, NULL, &size, &type, name.data());
+
+		// Uniforms inside blocks report location -1 and are not cached here
+		GLint location = glGetUniformLocation(programId, name.data());
+		if (location < 0)
+			continue;
+
+		Uniform u;
+		u.name = name.data();
+		// Arrays reflect as "name[0]"; strip the suffix so lookups use the plain name
+		size_t bracket = u.name.find('[');
+		if (bracket != std::string::npos)
+			u.name.erase(bracket);
+		u.location = location;
+		u.type = type;
+		u.offset = offset;
+		u.bytes = uniformTypeSize(type);
+		u.resident = false;
+		uniforms.push_back(u);
+		offset += u.bytes;
+	}
+	shadow.resize(offset);
+	return true;
+}
+
+UniformHandle ShaderProgram::handle(const char* name) const
+{
+	for (size_t i = 0; i < uniforms.size(); i++)
+	{
+		if (uniforms[i].name == name)
+			return (UniformHandle)i;
+	}
+	return -1;
+}
+
+// Compares against the shadow copy and records the new value when it differs
+bool ShaderProgram::changed(UniformHandle handle, GLenum type, const void* value, GLuint bytes)
+{
+	if (handle < 0 || handle >= (UniformHandle)uniforms.size())
+		return false;
+
+	Uniform& u = uniforms[handle];
+	if (u.type != type && !(isIntegerType(u.type) && type == GL_INT))
+		return false;
+
+	unsigned char* resident = &shadow[u.offset];
+	if (u.resident && memcmp(resident, value, bytes) == 0)
+	{
+		stats.skipped++;
+		return false;
+	}
+	memcpy(resident, value, bytes);
+	u.resident = true;
+	stats.uploads++;
+	return true;
+}
+
+void ShaderProgram::set(UniformHandle handle, GLint value)
+{
+	if (changed(handle, GL_INT, &value, sizeof(value)))
+		glProgramUniform1i(programId, uniforms[handle].location, value);
+}
+
+void ShaderProgram::set(UniformHandle handle, GLfloat value)
+{
+	if (changed(handle, GL_FLOAT, &value, sizeof(value)))
+		glProgramUniform1f(programId, uniforms[handle].location, value);
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec2& value)
+{
+	if (changed(handle, GL_FLOAT_VEC2, glm::value_ptr(value), sizeof(value)))
+		glProgramUniform2fv(programId, uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec3& value)
+{
+	if (changed(handle, GL_FLOAT_VEC3, glm::value_ptr(value), sizeof(value)))
+		glProgramUniform3fv(programId, uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec4& value)
+{
+	if (changed(handle, GL_FLOAT_VEC4, glm::value_ptr(value), sizeof(value)))
+		glProgramUniform4fv(programId, uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::mat3& value)
+{
+	if (changed(handle, GL_FLOAT_MAT3, glm::value_ptr(value), sizeof(value)))
+		glProgramUniformMatrix3fv(programId, uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::mat4& value)
+{
+	if (changed(handle, GL_FLOAT_MAT4, glm::value_ptr(value), sizeof(value)))
+		glProgramUniformMatrix4fv(programId, uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Index into a ShaderProgram's reflected uniform table, -1 when the uniform is not active
+typedef int UniformHandle;
+
+// Wraps a linked program. Active uniforms are reflected once after linking so the
+// render loop never calls glGetUniformLocation, and setters skip values that are
+// already resident on the program.
+class ShaderProgram
+{
+public:
+	struct FrameStats
+	{
+		GLuint uploads;  // glProgramUniform* calls issued this frame
+		GLuint skipped;  // setter calls whose value was already uploaded
+	};
+
+	ShaderProgram() : programId(0), stats() {}
+
+	bool reflect(GLuint program);
+	GLuint id() const { return programId; }
+	UniformHandle handle(const char* name) const;
+
+	void set(UniformHandle handle, GLint value);
+	void set(UniformHandle handle, GLfloat value);
+	void set(UniformHandle handle, const glm::vec2& value);
+	void set(UniformHandle handle, const glm::vec3& value);
+	void set(UniformHandle handle, const glm::vec4& value);
+	void set(UniformHandle handle, const glm::mat3& value);
+	void set(UniformHandle handle, const glm::mat4& value);
+
+	void beginFrame() { stats.uploads = stats.skipped = 0; }
+	const FrameStats& frameStats() const { return stats; }
+
+private:
+	struct Uniform
+	{
+		std::string name;
+		GLint location;
+		GLenum type;
+		GLuint offset;  // byte offset of the last uploaded value in shadow
+		GLuint bytes;
+		bool resident;  // false until the first upload
+	};
+
+	bool changed(UniformHandle handle, GLenum type, const void* value, GLuint bytes);
+
+	GLuint programId;
+	std::vector<Uniform> uniforms;
+	std::vector<unsigned char> shadow;
+	FrameStats stats;
+};
@@ -1,29 +1,172 @@
 #pragma once
 #include "Vertex.h"
-#include <GL/glew.h> 
+#include "BoundingVolume.h"
+#include "MeshArena.h"
+#include <GL/glew.h>
+#include <cassert>
+#include <cstring>
 //#include <glad/glad.h>
 
+// Owns a mesh's vertex and index arrays and frees them when it goes away. Given an arena, the
+// arrays come from it instead and are released with the arena. Move-only; view() and wrap()
+// make shapes that borrow memory owned elsewhere and never free it.
 struct ShapeData
 {
-	ShapeData() :
+	explicit ShapeData(MeshArena* arena = 0) :
 		vertices(0), numVertices(0),
-		indices(0), numIndices(0) {}
+		indices(0), numIndices(0), indexType(GL_UNSIGNED_SHORT), bounds(),
+		arena(arena), borrowed(false) {}
+	~ShapeData()
+	{
+		cleanup();
+	}
+	ShapeData(ShapeData&& other) :
+		vertices(other.vertices), numVertices(other.numVertices),
+		indices(other.indices), numIndices(other.numIndices), indexType(other.indexType), bounds(other.bounds),
+		arena(other.arena), borrowed(other.borrowed)
+	{
+		other.release();
+	}
+	ShapeData& operator=(ShapeData&& other)
+	{
+		if (this != &other)
+		{
+			cleanup();
+			vertices = other.vertices;
+			numVertices = other.numVertices;
+			indices = other.indices;
+			numIndices = other.numIndices;
+			indexType = other.indexType;
+			bounds = other.bounds;
+			arena = other.arena;
+			borrowed = other.borrowed;
+			other.release();
+		}
+		return *this;
+	}
+	ShapeData(const ShapeData&) = delete;
+	ShapeData& operator=(const ShapeData&) = delete;
+
+	// Borrows arrays that something else owns, such as a mapped cache file
+	static ShapeData wrap(Vertex* vertices, GLuint numVertices, void* indices, GLuint numIndices, GLenum indexType)
+	{
+		ShapeData ret;
+		ret.vertices = vertices;
+		ret.numVertices = numVertices;
+		ret.indices = indices;
+		ret.numIndices = numIndices;
+		ret.indexType = indexType;
+		ret.borrowed = true;
+		return ret;
+	}
+	// Borrows this shape's arrays; only valid while this shape keeps them
+	ShapeData view() const
+	{
+		ShapeData ret = wrap(vertices, numVertices, indices, numIndices, indexType);
+		ret.bounds = bounds;
+		return ret;
+	}
+
 	Vertex* vertices;
 	GLuint numVertices;
-	GLushort* indices;
+	void* indices;      // GLushort or GLuint elements, see indexType
 	GLuint numIndices;
+	GLenum indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, passed straight to glDrawElements
+	BoundingVolume bounds; // Filled in by ShapeGenerator
 	GLsizeiptr vertexBufferSize() const
 	{
 		return numVertices * sizeof(Vertex);
 	}
+	GLsizeiptr indexSize() const
+	{
+		return indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+	}
 	GLsizeiptr indexBufferSize() const
 	{
-		return numIndices * sizeof(GLushort);
+		return numIndices * indexSize();
+	}
+	// Vertices are left uninitialized for the generator to fill. Borrowed shapes never allocate:
+	// one flag covers both arrays, so a new array would be neither freed nor owned.
+	void allocateVertices(GLuint count)
+	{
+		assert(!borrowed);
+		freeVertices();
+		numVertices = count;
+		vertices = arena ? arena->allocateArray<Vertex>(count) : new Vertex[count];
+	}
+	// Picks the narrowest index type that can address vertexCount vertices
+	void allocateIndices(GLuint count, GLuint vertexCount)
+	{
+		assert(!borrowed);
+		freeIndices();
+		numIndices = count;
+		indexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		indices = newIndices(count);
+	}
+	// Grows or shrinks the index buffer, keeping its type and the leading indices. From an
+	// arena the old array stays allocated until the arena is released.
+	void resizeIndices(GLuint count)
+	{
+		assert(!borrowed);
+		GLuint kept = count < numIndices ? count : numIndices;
+		void* resized = newIndices(count);
+		memcpy(resized, indices, kept * indexSize());
+		freeIndices();
+		indices = resized;
+		numIndices = count;
+	}
+	GLuint index(GLuint i) const
+	{
+		return indexType == GL_UNSIGNED_INT ? ((const GLuint*)indices)[i] : ((const GLushort*)indices)[i];
 	}
+	void setIndex(GLuint i, GLuint value)
+	{
+		if (indexType == GL_UNSIGNED_INT)
+			((GLuint*)indices)[i] = value;
+		else
+			((GLushort*)indices)[i] = (GLushort)value;
+	}
+	// Frees the arrays now rather than when the shape goes away
 	void cleanup()
 	{
-		delete[] vertices;
-		delete[] indices;
+		freeVertices();
+		freeIndices();
+		release();
+	}
+
+private:
+	void* newIndices(GLuint count)
+	{
+		if (indexType == GL_UNSIGNED_INT)
+			return arena ? (void*)arena->allocateArray<GLuint>(count) : (void*)new GLuint[count];
+		return arena ? (void*)arena->allocateArray<GLushort>(count) : (void*)new GLushort[count];
+	}
+	void freeVertices()
+	{
+		if (!arena && !borrowed)
+			delete[] vertices;
+		vertices = 0;
+	}
+	void freeIndices()
+	{
+		if (!arena && !borrowed)
+		{
+			if (indexType == GL_UNSIGNED_INT)
+				delete[] (GLuint*)indices;
+			else
+				delete[] (GLushort*)indices;
+		}
+		indices = 0;
+	}
+	// Forgets the arrays without freeing them
+	void release()
+	{
+		vertices = 0;
+		indices = 0;
 		numVertices = numIndices = 0;
+		borrowed = false;
 	}
+
+	MeshArena* arena;   // null for new[] storage
+	bool borrowed;      // arrays belong to someone else
 };
\ No newline at end of file
@@ -3,9 +3,13 @@
 //#include <glm\gtc\matrix_transform.hpp>
 #include "Vertex.h"
 #include <math.h> 
+#include <assert.h>
+#include <vector>
+#include <unordered_map>
 
 
 #define PI 3.14159265359
+using glm::vec2;
 using glm::vec3;
 using glm::mat4;
 using glm::mat3;
@@ -21,12 +25,11 @@ glm::vec3 randomColor()
 }
 
 
-ShapeData ShapeGenerator::makePlaneVerts(uint dimensions)
+ShapeData ShapeGenerator::makePlaneVerts(uint dimensions, MeshArena* arena)
 {
-	ShapeData ret;
-	ret.numVertices = dimensions * dimensions;
+	ShapeData ret(arena);
 	int half = dimensions / 2;
-	ret.vertices = new Vertex[ret.numVertices];
+	ret.allocateVertices(dimensions * dimensions);
 	for (int i = 0; i < dimensions; i++)
 	{
 		for (int j = 0; j < dimensions; j++)
@@ -36,51 +39,47 @@ ShapeData ShapeGenerator::makePlaneVerts(uint dimensions)
 			thisVert.position.z = i - half;
 			thisVert.position.y = 0;
 			thisVert.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			thisVert.uv = glm::vec2(j / (float)(dimensions - 1), i / (float)(dimensions - 1));
 			thisVert.color = randomColor();
 		}
 	}
 	return ret;
 }
 
-ShapeData ShapeGenerator::makePlaneIndices(uint dimensions)
+void ShapeGenerator::fillPlaneIndices(ShapeData& ret, uint dimensions)
 {
-	ShapeData ret;
-	ret.numIndices = (dimensions - 1) * (dimensions - 1) * 2 * 3; // 2 triangles per square, 3 indices per triangle
-	ret.indices = new unsigned short[ret.numIndices];
-	int runner = 0;
-	for (int row = 0; row < dimensions - 1; row++)
+	// 2 triangles per square, 3 indices per triangle; 16-bit indices only up to 256x256
+	ret.allocateIndices((dimensions - 1) * (dimensions - 1) * 2 * 3, dimensions * dimensions);
+	uint runner = 0;
+	for (uint row = 0; row < dimensions - 1; row++)
 	{
-		for (int col = 0; col < dimensions - 1; col++)
+		for (uint col = 0; col < dimensions - 1; col++)
 		{
-			ret.indices[runner++] = dimensions * row + col;
-			ret.indices[runner++] = dimensions * row + col + dimensions;
-			ret.indices[runner++] = dimensions * row + col + dimensions + 1;
+			ret.setIndex(runner++, dimensions * row + col);
+			ret.setIndex(runner++, dimensions * row + col + dimensions);
+			ret.setIndex(runner++, dimensions * row + col + dimensions + 1);
 
-			ret.indices[runner++] = dimensions * row + col;
-			ret.indices[runner++] = dimensions * row + col + dimensions + 1;
-			ret.indices[runner++] = dimensions * row + col + 1;
+			ret.setIndex(runner++, dimensions * row + col);
+			ret.setIndex(runner++, dimensions * row + col + dimensions + 1);
+			ret.setIndex(runner++, dimensions * row + col + 1);
 		}
 	}
-	assert(runner = ret.numIndices);
-	return ret;
+	assert(runner == ret.numIndices);
 }
 
 
-ShapeData ShapeGenerator::makePlane(uint dimensions)
+ShapeData ShapeGenerator::makePlane(uint dimensions, MeshArena* arena)
 {
-	ShapeData ret = makePlaneVerts(dimensions);
-	ShapeData ret2 = makePlaneIndices(dimensions);
-	ret.numIndices = ret2.numIndices;
-	ret.indices = ret2.indices;
+	ShapeData ret = makePlaneVerts(dimensions, arena);
+	fillPlaneIndices(ret, dimensions);
+	ret.bounds = computeBounds(ret.vertices, ret.numVertices);
 	return ret;
 }
 
-ShapeData ShapeGenerator::makeSphere(uint tesselation)
+ShapeData ShapeGenerator::makeSphere(uint tesselation, MeshArena* arena)
 {
-	ShapeData ret = makePlaneVerts(tesselation);
-	ShapeData ret2 = makePlaneIndices(tesselation);
-	ret.indices = ret2.indices;
-	ret.numIndices = ret2.numIndices;
+	ShapeData ret = makePlaneVerts(tesselation, arena);
+	fillPlaneIndices(ret, tesselation);
 
 	uint dimensions = tesselation;
 	const float RADIUS = 1.0f;
@@ -97,9 +96,350 @@ ShapeData ShapeGenerator::makeSphere(uint tesselation)
 			v.position.x = RADIUS * cos(phi) * sin(theta);
 			v.position.y = RADIUS * sin(phi) * sin(theta);
 			v.position.z = RADIUS * cos(theta);
+			v.normal = v.position / RADIUS;
 			// Converts relative position into desired section of the texture palette.
-			v.normal = glm::vec3(fabs(v.position.x / 4.0f) + 0.251f, fabs(v.position.y / 4.0f) + 0.251f, v.position.z - v.position.z);
+			v.uv = glm::vec2(fabs(v.position.x / 4.0f) + 0.251f, fabs(v.position.y / 4.0f) + 0.251f);
+		}
+	}
+	ret.bounds = computeBounds(ret.vertices, ret.numVertices);
+	return ret;
+}
+
+namespace
+{
+	// Returns the index of the vertex halfway along edge (a, b), creating it the first time the edge is seen
+	class EdgeMidpointCache
+	{
+	public:
+		explicit EdgeMidpointCache(std::vector<vec3>& positions) : positions(positions) {}
+
+		GLuint midpoint(GLuint a, GLuint b)
+		{
+			unsigned long long key = a < b
+				? ((unsigned long long)a << 32) | b
+				: ((unsigned long long)b << 32) | a;
+			std::unordered_map<unsigned long long, GLuint>::iterator it = cache.find(key);
+			if (it != cache.end())
+				return it->second;
+
+			GLuint index = (GLuint)positions.size();
+			positions.push_back((positions[a] + positions[b]) * 0.5f);
+			cache.emplace(key, index);
+			return index;
+		}
+
+		void reserve(size_t edges) { cache.reserve(edges); }
+
+	private:
+		std::vector<vec3>& positions;
+		std::unordered_map<unsigned long long, GLuint> cache;
+	};
+
+	// Packs unit-sphere points into the makeSphere vertex layout
+	ShapeData emitUnitSphere(const std::vector<vec3>& positions, const std::vector<GLuint>& indices, MeshArena* arena)
+	{
+		ShapeData ret(arena);
+		ret.allocateVertices((GLuint)positions.size());
+		for (GLuint i = 0; i < ret.numVertices; i++)
+		{
+			Vertex& v = ret.vertices[i];
+			v.position = positions[i];
+			v.color = vec3(1.0f);
+			v.normal = positions[i];
+			// Converts relative position into desired section of the texture palette.
+			v.uv = glm::vec2(fabs(v.position.x / 4.0f) + 0.251f, fabs(v.position.y / 4.0f) + 0.251f);
+		}
+		ret.allocateIndices((GLuint)indices.size(), ret.numVertices);
+		for (GLuint i = 0; i < ret.numIndices; i++)
+			ret.setIndex(i, indices[i]);
+		ret.bounds = computeBounds(ret.vertices, ret.numVertices);
+		return ret;
+	}
+}
+
+ShapeData ShapeGenerator::makeIcosphere(uint subdivisions, MeshArena* arena)
+{
+	const float T = (float)((1.0 + sqrt(5.0)) / 2.0);
+	std::vector<vec3> positions = {
+		vec3(-1, T, 0), vec3(1, T, 0), vec3(-1, -T, 0), vec3(1, -T, 0),
+		vec3(0, -1, T), vec3(0, 1, T), vec3(0, -1, -T), vec3(0, 1, -T),
+		vec3(T, 0, -1), vec3(T, 0, 1), vec3(-T, 0, -1), vec3(-T, 0, 1),
+	};
+	std::vector<GLuint> indices = {
+		0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+		1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+		3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+		4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1,
+	};
+	for (size_t i = 0; i < positions.size(); i++)
+		positions[i] = glm::normalize(positions[i]);
+
+	// Each pass splits every triangle into four; V = 10 * 4^n + 2
+	size_t finalVertices = 10 * ((size_t)1 << (2 * subdivisions)) + 2;
+	positions.reserve(finalVertices);
+	for (uint level = 0; level < subdivisions; level++)
+	{
+		EdgeMidpointCache midpoints(positions);
+		midpoints.reserve(indices.size() / 2);
+		size_t firstNew = positions.size();
+
+		std::vector<GLuint> split;
+		split.reserve(indices.size() * 4);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			GLuint a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			GLuint ab = midpoints.midpoint(a, b);
+			GLuint bc = midpoints.midpoint(b, c);
+			GLuint ca = midpoints.midpoint(c, a);
+			GLuint tris[] = { a, ab, ca,   b, bc, ab,   c, ca, bc,   ab, bc, ca };
+			split.insert(split.end(), tris, tris + NUM_ARRAY_ELEMENTS(tris));
+		}
+		// Midpoints are pushed back onto the sphere before the next level splits them again
+		for (size_t i = firstNew; i < positions.size(); i++)
+			positions[i] = glm::normalize(positions[i]);
+		indices.swap(split);
+	}
+	return emitUnitSphere(positions, indices, arena);
+}
+
+ShapeData ShapeGenerator::makeCubeSphere(uint subdivisions, MeshArena* arena)
+{
+	std::vector<vec3> positions;
+	for (int corner = 0; corner < 8; corner++)
+		positions.push_back(vec3(corner & 4 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 1 ? 1.0f : -1.0f));
+	// Counter-clockwise quads seen from outside: +X, -X, +Y, -Y, +Z, -Z
+	std::vector<GLuint> quads = {
+		4, 6, 7, 5,   0, 1, 3, 2,
+		2, 3, 7, 6,   0, 4, 5, 1,
+		1, 5, 7, 3,   0, 2, 6, 4,
+	};
+
+	// Quads are split on the cube itself so the lattice stays regular; edges shared
+	// by neighbouring faces go through the cache, quad centres are always new
+	for (uint level = 0; level < subdivisions; level++)
+	{
+		EdgeMidpointCache midpoints(positions);
+		midpoints.reserve(quads.size() / 2);
+
+		std::vector<GLuint> split;
+		split.reserve(quads.size() * 4);
+		for (size_t i = 0; i < quads.size(); i += 4)
+		{
+			GLuint a = quads[i], b = quads[i + 1], c = quads[i + 2], d = quads[i + 3];
+			GLuint ab = midpoints.midpoint(a, b);
+			GLuint bc = midpoints.midpoint(b, c);
+			GLuint cd = midpoints.midpoint(c, d);
+			GLuint da = midpoints.midpoint(d, a);
+			GLuint centre = (GLuint)positions.size();
+			positions.push_back((positions[a] + positions[c]) * 0.5f);
+			GLuint children[] = { a, ab, centre, da,   ab, b, bc, centre,   centre, bc, c, cd,   da, centre, cd, d };
+			split.insert(split.end(), children, children + NUM_ARRAY_ELEMENTS(children));
+		}
+		quads.swap(split);
+	}
+
+	// Area-preserving cube-to-sphere map; plain normalisation bunches triangles at the face centres
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		vec3 p = positions[i];
+		vec3 sq = p * p;
+		positions[i] = vec3(
+			p.x * sqrt(1.0f - sq.y / 2.0f - sq.z / 2.0f + sq.y * sq.z / 3.0f),
+			p.y * sqrt(1.0f - sq.z / 2.0f - sq.x / 2.0f + sq.z * sq.x / 3.0f),
+			p.z * sqrt(1.0f - sq.x / 2.0f - sq.y / 2.0f + sq.x * sq.y / 3.0f));
+	}
+
+	std::vector<GLuint> indices;
+	indices.reserve(quads.size() / 4 * 6);
+	for (size_t i = 0; i < quads.size(); i += 4)
+	{
+		GLuint tris[] = { quads[i], quads[i + 1], quads[i + 2],   quads[i], quads[i + 2], quads[i + 3] };
+		indices.insert(indices.end(), tris, tris + NUM_ARRAY_ELEMENTS(tris));
+	}
+	return emitUnitSphere(positions, indices, arena);
+}
+
+ShapeData ShapeGenerator::makeTorus(uint rings, uint sides, float majorRadius, float minorRadius, float sweep, MeshArena* arena)
+{
+	// The seam column and row are duplicated so u and v reach 1.0
+	uint columns = rings + 1;
+	uint rows = sides + 1;
+	ShapeData ret(arena);
+	ret.allocateVertices(columns * rows);
+	for (uint i = 0; i < columns; i++)
+	{
+		float u = i / (float)rings;
+		float theta = sweep * (u - 0.5f);
+		vec3 outward(cos(theta), 0.0f, sin(theta));
+		for (uint j = 0; j < rows; j++)
+		{
+			float v = j / (float)sides;
+			float phi = (float)(PI * 2) * v;
+			Vertex& vert = ret.vertices[i * rows + j];
+			vert.normal = outward * cos(phi) + vec3(0.0f, sin(phi), 0.0f);
+			vert.position = outward * majorRadius + vert.normal * minorRadius;
+			vert.color = vec3(1.0f);
+			vert.uv = vec2(u, v);
+		}
+	}
+
+	ret.allocateIndices(rings * sides * 6, ret.numVertices);
+	uint runner = 0;
+	for (uint i = 0; i < rings; i++)
+	{
+		for (uint j = 0; j < sides; j++)
+		{
+			GLuint a = i * rows + j;
+			GLuint b = a + rows;
+			ret.setIndex(runner++, a);
+			ret.setIndex(runner++, a + 1);
+			ret.setIndex(runner++, b);
+
+			ret.setIndex(runner++, b);
+			ret.setIndex(runner++, a + 1);
+			ret.setIndex(runner++, b + 1);
+		}
+	}
+	assert(runner == ret.numIndices);
+	ret.bounds = computeBounds(ret.vertices, ret.numVertices);
+	return ret;
+}
+
+ShapeData ShapeGenerator::makeRevolved(uint segments, float radius, float height, bool smoothSides, bool bottomCap, bool topCap, MeshArena* arena)
+{
+	uint capCount = (bottomCap ? 1 : 0) + (topCap ? 1 : 0);
+	// Smooth sides share one column per angle; flat sides need their own pair of columns per face
+	uint sideColumns = smoothSides ? segments + 1 : segments * 2;
+	ShapeData ret(arena);
+	ret.allocateVertices(sideColumns * 2 + capCount * (segments + 1));
+	ret.allocateIndices(segments * 6 + capCount * segments * 3, ret.numVertices);
+
+	GLuint vertexRunner = 0;
+	uint runner = 0;
+	const double SLICE_ANGLE = PI * 2 / segments;
+
+	// Fan around a centre vertex; texture coordinates are a disc inscribed in the 0..1 square
+	auto addCap = [&](float y, float normalY)
+	{
+		GLuint centre = vertexRunner;
+		Vertex& mid = ret.vertices[vertexRunner++];
+		mid.position = vec3(0.0f, y, 0.0f);
+		mid.color = vec3(1.0f);
+		mid.normal = vec3(0.0f, normalY, 0.0f);
+		mid.uv = vec2(0.5f, 0.5f);
+		for (uint k = 0; k < segments; k++)
+		{
+			double angle = SLICE_ANGLE * k;
+			Vertex& rim = ret.vertices[vertexRunner++];
+			rim.position = vec3(radius * cos(angle), y, radius * sin(angle));
+			rim.color = vec3(1.0f);
+			rim.normal = mid.normal;
+			rim.uv = vec2(0.5f + 0.5f * (float)cos(angle), 0.5f + 0.5f * (float)sin(angle));
+		}
+		for (uint k = 0; k < segments; k++)
+		{
+			GLuint first = centre + 1 + k;
+			GLuint second = centre + 1 + (k + 1) % segments;
+			// Counter-clockwise when seen from the side the cap faces
+			ret.setIndex(runner++, centre);
+			ret.setIndex(runner++, normalY < 0.0f ? first : second);
+			ret.setIndex(runner++, normalY < 0.0f ? second : first);
+		}
+	};
+
+	if (bottomCap)
+		addCap(0.0f, -1.0f);
+
+	// Each side column is a bottom/top vertex pair
+	GLuint sideBase = vertexRunner;
+	for (uint c = 0; c < sideColumns; c++)
+	{
+		uint k = smoothSides ? c : (c + 1) / 2;
+		double angle = SLICE_ANGLE * k;
+		vec3 rim((float)cos(angle), 0.0f, (float)sin(angle));
+		vec3 normal = rim;
+		if (!smoothSides)
+		{
+			double faceAngle = SLICE_ANGLE * (c / 2 + 0.5);
+			normal = vec3((float)cos(faceAngle), 0.0f, (float)sin(faceAngle));
+		}
+		for (int level = 0; level < 2; level++)
+		{
+			Vertex& vert = ret.vertices[vertexRunner++];
+			vert.position = rim * radius + vec3(0.0f, level * height, 0.0f);
+			vert.color = vec3(1.0f);
+			vert.normal = normal;
+			vert.uv = vec2(k / (float)segments, (float)level);
+		}
+	}
+	for (uint k = 0; k < segments; k++)
+	{
+		GLuint bottom0 = sideBase + (smoothSides ? k : k * 2) * 2;
+		GLuint bottom1 = bottom0 + 2;
+		ret.setIndex(runner++, bottom0);
+		ret.setIndex(runner++, bottom0 + 1);
+		ret.setIndex(runner++, bottom1);
+
+		ret.setIndex(runner++, bottom1);
+		ret.setIndex(runner++, bottom0 + 1);
+		ret.setIndex(runner++, bottom1 + 1);
+	}
+
+	if (topCap)
+		addCap(height, 1.0f);
+
+	assert(vertexRunner == ret.numVertices);
+	assert(runner == ret.numIndices);
+	ret.bounds = computeBounds(ret.vertices, ret.numVertices);
+	return ret;
+}
+
+ShapeData ShapeGenerator::makeCylinder(uint segments, float radius, float height, bool bottomCap, bool topCap, MeshArena* arena)
+{
+	return makeRevolved(segments, radius, height, true, bottomCap, topCap, arena);
+}
+
+ShapeData ShapeGenerator::makePrism(uint sides, float radius, float height, MeshArena* arena)
+{
+	return makeRevolved(sides, radius, height, false, true, true, arena);
+}
+
+void ShapeGenerator::fitUVs(ShapeData& shape, glm::vec2 uvMin, glm::vec2 uvMax)
+{
+	for (GLuint i = 0; i < shape.numVertices; i++)
+		shape.vertices[i].uv = uvMin + shape.vertices[i].uv * (uvMax - uvMin);
+}
+
+ShapeData ShapeGenerator::combine(const ShapeData* shapes, const glm::mat4* transforms, uint count, MeshArena* arena)
+{
+	ShapeData ret(arena);
+	GLuint totalVertices = 0;
+	GLuint totalIndices = 0;
+	for (uint s = 0; s < count; s++)
+	{
+		totalVertices += shapes[s].numVertices;
+		totalIndices += shapes[s].numIndices;
+	}
+	ret.allocateVertices(totalVertices);
+	ret.allocateIndices(totalIndices, totalVertices);
+
+	GLuint vertexBase = 0;
+	GLuint runner = 0;
+	for (uint s = 0; s < count; s++)
+	{
+		const ShapeData& shape = shapes[s];
+		mat3 normalMatrix = glm::transpose(glm::inverse(mat3(transforms[s])));
+		for (GLuint i = 0; i < shape.numVertices; i++)
+		{
+			Vertex& vert = ret.vertices[vertexBase + i];
+			vert = shape.vertices[i];
+			vert.position = vec3(transforms[s] * glm::vec4(vert.position, 1.0f));
+			vert.normal = glm::normalize(normalMatrix * vert.normal);
 		}
+		for (GLuint i = 0; i < shape.numIndices; i++)
+			ret.setIndex(runner++, vertexBase + shape.index(i));
+		vertexBase += shape.numVertices;
 	}
+	ret.bounds = computeBounds(ret.vertices, ret.numVertices);
 	return ret;
-}
\ No newline at end of file
+}
@@ -4,14 +4,32 @@ typedef unsigned int uint;
 
 class ShapeGenerator
 {
-	static ShapeData makePlaneVerts(uint dimensions);
-	static ShapeData makePlaneIndices(uint dimensions);
+	static ShapeData makePlaneVerts(uint dimensions, MeshArena* arena);
+	static void fillPlaneIndices(ShapeData& shape, uint dimensions);
+	static ShapeData makeRevolved(uint segments, float radius, float height, bool smoothSides, bool bottomCap, bool topCap, MeshArena* arena);
 
 
 public:
+	// Every generator allocates from arena when one is given, and with new[] otherwise
 
-	static ShapeData makePlane(uint dimensions = 10);
-	static ShapeData makeSphere(uint tesselation = 20);
+	static ShapeData makePlane(uint dimensions = 10, MeshArena* arena = 0);
+	static ShapeData makeSphere(uint tesselation = 20, MeshArena* arena = 0);
+	// Unit spheres without a seam column or pole fans; shared vertices are emitted once through an edge-midpoint cache
+	static ShapeData makeIcosphere(uint subdivisions = 2, MeshArena* arena = 0);
+	static ShapeData makeCubeSphere(uint subdivisions = 3, MeshArena* arena = 0);
+
+	// Ring of the given radii around +Y; a sweep below a full turn leaves an open arc centred on +X.
+	// Texture coordinates run 0..1 along the ring (u) and around the tube (v)
+	static ShapeData makeTorus(uint rings = 24, uint sides = 12, float majorRadius = 1.0f, float minorRadius = 0.25f, float sweep = 6.28318530718f, MeshArena* arena = 0);
+	// Smooth-sided cylinder standing on the XZ plane. Index order is bottom cap, sides, top cap
+	static ShapeData makeCylinder(uint segments = 16, float radius = 1.0f, float height = 1.0f, bool bottomCap = true, bool topCap = true, MeshArena* arena = 0);
+	// Capped N-gon prism with a flat normal per side, same layout as makeCylinder
+	static ShapeData makePrism(uint sides, float radius = 1.0f, float height = 1.0f, MeshArena* arena = 0);
+
+	// Maps generated 0..1 texture coordinates into one cell of the texture atlas
+	static void fitUVs(ShapeData& shape, glm::vec2 uvMin, glm::vec2 uvMax);
+	// Concatenates shapes into one indexed mesh, moving each into place with its transform
+	static ShapeData combine(const ShapeData* shapes, const glm::mat4* transforms, uint count, MeshArena* arena = 0);
 
 };
 
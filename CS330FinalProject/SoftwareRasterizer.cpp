@@ -0,0 +1,609 @@
+#include "SoftwareRasterizer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Planes of a set-up triangle: depth, 1/w, then the eight attributes divided by w
+	const int PLANE_DEPTH = 0;
+	const int PLANE_INV_W = 1;
+	const int PLANE_ATTRIBUTES = 2;
+	const int ATTRIBUTE_COUNT = 8;
+	const int LIT_PLANE_COUNT = PLANE_ATTRIBUTES + ATTRIBUTE_COUNT;
+	// Attribute layout of a clip vertex
+	const int ATTRIBUTE_POSITION = 0;
+	const int ATTRIBUTE_NORMAL = 3;
+	const int ATTRIBUTE_UV = 6;
+	// Fewest triangles one binning chunk sets up
+	const size_t MIN_BIN_GRAIN = 512;
+	// Same as the Phong program; its highlightSize of 1 makes the specular power a no-op
+	const float SPECULAR_INTENSITY = 0.3f;
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	float saturate(float value)
+	{
+		return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+	}
+
+	// RGBA8 with red in the low byte, as GL_RGBA / GL_UNSIGNED_BYTE
+	uint32_t packColor(float r, float g, float b, float a)
+	{
+		return (uint32_t)(saturate(r) * 255.0f + 0.5f) | (uint32_t)(saturate(g) * 255.0f + 0.5f) << 8
+			| (uint32_t)(saturate(b) * 255.0f + 0.5f) << 16 | (uint32_t)(saturate(a) * 255.0f + 0.5f) << 24;
+	}
+
+	// Everything a lit pixel needs besides its interpolated attributes
+	struct ShadeContext
+	{
+		const uint32_t* texels;
+		int textureWidth;
+		int textureHeight;
+		glm::vec3 eye;
+		const PointLight* lights;
+		int lightCount;
+		glm::vec4 color;
+	};
+
+	// GL_LINEAR with GL_REPEAT: the four texels around the sample point, weighted by distance
+	void sampleBilinear(const ShadeContext& context, float u, float v, float* rgb)
+	{
+		if (context.textureWidth == 0)
+		{
+			rgb[0] = rgb[1] = rgb[2] = 1.0f;
+			return;
+		}
+		int width = context.textureWidth, height = context.textureHeight;
+		float fu = u * width - 0.5f, fv = v * height - 0.5f;
+		float floorU = floorf(fu), floorV = floorf(fv);
+		float fx = fu - floorU, fy = fv - floorV;
+		int x0 = (int)fmodf(floorU, (float)width), y0 = (int)fmodf(floorV, (float)height);
+		if (x0 < 0)
+			x0 += width;
+		if (y0 < 0)
+			y0 += height;
+		int x1 = x0 + 1 < width ? x0 + 1 : 0, y1 = y0 + 1 < height ? y0 + 1 : 0;
+		uint32_t t00 = context.texels[y0 * width + x0], t10 = context.texels[y0 * width + x1];
+		uint32_t t01 = context.texels[y1 * width + x0], t11 = context.texels[y1 * width + x1];
+		float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy), w01 = (1.0f - fx) * fy, w11 = fx * fy;
+		for (int channel = 0; channel < 3; channel++)
+		{
+			int shift = channel * 8;
+			float sum = w00 * ((t00 >> shift) & 0xFF) + w10 * ((t10 >> shift) & 0xFF) + w01 * ((t01 >> shift) & 0xFF) + w11 * ((t11 >> shift) & 0xFF);
+			rgb[channel] = sum * (1.0f / 255.0f);
+		}
+	}
+
+	// The Phong program for one pixel
+	uint32_t shadePixel(const ShadeContext& context, const float* attributes)
+	{
+		glm::vec3 position(attributes[ATTRIBUTE_POSITION], attributes[ATTRIBUTE_POSITION + 1], attributes[ATTRIBUTE_POSITION + 2]);
+		glm::vec3 norm = glm::normalize(glm::vec3(attributes[ATTRIBUTE_NORMAL], attributes[ATTRIBUTE_NORMAL + 1], attributes[ATTRIBUTE_NORMAL + 2]));
+		glm::vec3 viewDir = glm::normalize(context.eye - position);
+		glm::vec3 lighting(0.0f);
+		for (int i = 0; i < context.lightCount; i++)
+		{
+			const PointLight& light = context.lights[i];
+			glm::vec3 lightDirection = glm::normalize(light.position - position);
+			float impact = glm::dot(norm, lightDirection);
+			glm::vec3 reflectDir = 2.0f * impact * norm - lightDirection;
+			float specular = std::max(glm::dot(viewDir, reflectDir), 0.0f);
+			lighting += (light.ambientStrength + std::max(impact, 0.0f) + SPECULAR_INTENSITY * specular) * light.color;
+		}
+		float texel[3];
+		sampleBilinear(context, attributes[ATTRIBUTE_UV], attributes[ATTRIBUTE_UV + 1], texel);
+		return packColor(lighting.x * texel[0] * context.color.x, lighting.y * texel[1] * context.color.y,
+			lighting.z * texel[2] * context.color.z, 1.0f);
+	}
+
+#ifdef RASTER_SSE
+	__m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+	}
+
+	void normalize3(__m128& x, __m128& y, __m128& z)
+	{
+		__m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot3(x, y, z, x, y, z)));
+		x = _mm_mul_ps(x, invLength);
+		y = _mm_mul_ps(y, invLength);
+		z = _mm_mul_ps(z, invLength);
+	}
+
+	__m128i packQuad(__m128 r, __m128 g, __m128 b, __m128 a)
+	{
+		// max() first so NaNs from degenerate lanes come out as 0
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+		__m128i ri = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale));
+		__m128i gi = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale));
+		__m128i bi = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), scale));
+		__m128i ai = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(a, zero), one), scale));
+		return _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)), _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_slli_epi32(ai, 24)));
+	}
+
+	// The Phong program for four pixels; texels are fetched one lane at a time
+	__m128i shadeQuad(const ShadeContext& context, const __m128* attributes)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		__m128 px = attributes[ATTRIBUTE_POSITION], py = attributes[ATTRIBUTE_POSITION + 1], pz = attributes[ATTRIBUTE_POSITION + 2];
+		__m128 nx = attributes[ATTRIBUTE_NORMAL], ny = attributes[ATTRIBUTE_NORMAL + 1], nz = attributes[ATTRIBUTE_NORMAL + 2];
+		normalize3(nx, ny, nz);
+		__m128 vx = _mm_sub_ps(_mm_set1_ps(context.eye.x), px);
+		__m128 vy = _mm_sub_ps(_mm_set1_ps(context.eye.y), py);
+		__m128 vz = _mm_sub_ps(_mm_set1_ps(context.eye.z), pz);
+		normalize3(vx, vy, vz);
+
+		__m128 r = zero, g = zero, b = zero;
+		for (int i = 0; i < context.lightCount; i++)
+		{
+			const PointLight& light = context.lights[i];
+			__m128 lx = _mm_sub_ps(_mm_set1_ps(light.position.x), px);
+			__m128 ly = _mm_sub_ps(_mm_set1_ps(light.position.y), py);
+			__m128 lz = _mm_sub_ps(_mm_set1_ps(light.position.z), pz);
+			normalize3(lx, ly, lz);
+			__m128 impact = dot3(nx, ny, nz, lx, ly, lz);
+			__m128 twice = _mm_add_ps(impact, impact);
+			__m128 rx = _mm_sub_ps(_mm_mul_ps(twice, nx), lx);
+			__m128 ry = _mm_sub_ps(_mm_mul_ps(twice, ny), ly);
+			__m128 rz = _mm_sub_ps(_mm_mul_ps(twice, nz), lz);
+			__m128 specular = _mm_max_ps(dot3(vx, vy, vz, rx, ry, rz), zero);
+			__m128 strength = _mm_add_ps(_mm_add_ps(_mm_set1_ps(light.ambientStrength), _mm_max_ps(impact, zero)),
+				_mm_mul_ps(_mm_set1_ps(SPECULAR_INTENSITY), specular));
+			r = _mm_add_ps(r, _mm_mul_ps(strength, _mm_set1_ps(light.color.x)));
+			g = _mm_add_ps(g, _mm_mul_ps(strength, _mm_set1_ps(light.color.y)));
+			b = _mm_add_ps(b, _mm_mul_ps(strength, _mm_set1_ps(light.color.z)));
+		}
+
+		float u[4], v[4], texR[4], texG[4], texB[4];
+		_mm_storeu_ps(u, attributes[ATTRIBUTE_UV]);
+		_mm_storeu_ps(v, attributes[ATTRIBUTE_UV + 1]);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			float texel[3];
+			sampleBilinear(context, u[lane], v[lane], texel);
+			texR[lane] = texel[0];
+			texG[lane] = texel[1];
+			texB[lane] = texel[2];
+		}
+		r = _mm_mul_ps(_mm_mul_ps(r, _mm_loadu_ps(texR)), _mm_set1_ps(context.color.x));
+		g = _mm_mul_ps(_mm_mul_ps(g, _mm_loadu_ps(texG)), _mm_set1_ps(context.color.y));
+		b = _mm_mul_ps(_mm_mul_ps(b, _mm_loadu_ps(texB)), _mm_set1_ps(context.color.z));
+		return packQuad(r, g, b, _mm_set1_ps(1.0f));
+	}
+#endif
+}
+
+SoftwareRasterizer::SoftwareRasterizer() :
+	textureWidth(0), textureHeight(0), frameWidth(0), frameHeight(0), frameStride(0), tilesX(0), tilesY(0), clearValue(0),
+	viewProjection(1.0f), eye(0.0f), frameLightCount(0), frameUvScale(1.0f), activeChunks(0),
+	triangleTotal(0), vertexTime(0.0), binTime(0.0), rasterTime(0.0)
+{
+}
+
+int SoftwareRasterizer::addMesh(const ShapeData& shape)
+{
+	meshes.push_back(Mesh());
+	Mesh& mesh = meshes.back();
+	mesh.vertices.assign(shape.vertices, shape.vertices + shape.numVertices);
+	mesh.indices.resize(shape.numIndices);
+	for (GLuint i = 0; i < shape.numIndices; i++)
+		mesh.indices[i] = shape.index(i);
+	return (int)meshes.size() - 1;
+}
+
+void SoftwareRasterizer::setTexture(const unsigned char* pixels, int width, int height, int channels)
+{
+	textureWidth = width;
+	textureHeight = height;
+	texture.resize((size_t)width * height);
+	for (size_t i = 0; i < texture.size(); i++)
+	{
+		const unsigned char* texel = pixels + i * channels;
+		uint32_t alpha = channels == 4 ? texel[3] : 255;
+		texture[i] = texel[0] | texel[1] << 8 | texel[2] << 16 | alpha << 24;
+	}
+}
+
+void SoftwareRasterizer::beginFrame(int width, int height, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition,
+	const PointLight* lights, int lightCount, const glm::vec2& uvScale, const glm::vec4& clearColor)
+{
+	if (width != frameWidth || height != frameHeight)
+	{
+		// Rows are padded to a multiple of 4 so a group of 4 pixels never spans two rows
+		frameWidth = width;
+		frameHeight = height;
+		frameStride = (width + 3) & ~3;
+		tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+		tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+		color.resize((size_t)frameStride * height);
+		depth.resize((size_t)frameStride * height);
+	}
+	viewProjection = projection * view;
+	eye = viewPosition;
+	frameLightCount = std::min(lightCount, RASTER_MAX_LIGHTS);
+	for (int i = 0; i < frameLightCount; i++)
+		frameLights[i] = lights[i];
+	frameUvScale = uvScale;
+	clearValue = packColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
+	draws.clear();
+}
+
+void SoftwareRasterizer::drawLit(int mesh, GLuint firstIndex, GLuint indexCount, const glm::mat4& model, const glm::vec4& color)
+{
+	addDraw(mesh, firstIndex, indexCount, model, color, true);
+}
+
+void SoftwareRasterizer::drawFlat(int mesh, GLuint firstIndex, GLuint indexCount, const glm::mat4& model, const glm::vec4& color)
+{
+	addDraw(mesh, firstIndex, indexCount, model, color, false);
+}
+
+void SoftwareRasterizer::addDraw(int mesh, GLuint firstIndex, GLuint indexCount, const glm::mat4& model, const glm::vec4& color, bool lit)
+{
+	if (indexCount < 3)
+		return;
+
+	// Only the vertices between the lowest and highest index of the range are transformed
+	Mesh& source = meshes[mesh];
+	std::pair<GLuint, GLuint> range(firstIndex, indexCount);
+	std::map<std::pair<GLuint, GLuint>, std::pair<GLuint, GLuint> >::iterator used = source.rangeVertices.find(range);
+	if (used == source.rangeVertices.end())
+	{
+		const GLuint* first = &source.indices[firstIndex];
+		const GLuint* last = first + indexCount;
+		used = source.rangeVertices.insert(std::make_pair(range, std::make_pair(*std::min_element(first, last), *std::max_element(first, last)))).first;
+	}
+
+	Draw draw;
+	draw.mesh = mesh;
+	draw.firstIndex = firstIndex;
+	draw.indexCount = indexCount - indexCount % 3;
+	draw.firstVertex = used->second.first;
+	draw.vertexCount = used->second.second - used->second.first + 1;
+	draw.clipBase = 0;
+	draw.triangleBase = 0;
+	draw.mvp = viewProjection * model;
+	draw.model = model;
+	draw.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	draw.color = color;
+	draw.lit = lit;
+	draws.push_back(draw);
+}
+
+void SoftwareRasterizer::render()
+{
+	ThreadPool& pool = ThreadPool::shared();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Vertex stage: every draw's vertices in one flat range split across the pool
+	size_t vertexTotal = 0, triangleCount = 0;
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		draws[i].clipBase = vertexTotal;
+		vertexTotal += draws[i].vertexCount;
+		draws[i].triangleBase = triangleCount;
+		triangleCount += draws[i].indexCount / 3;
+	}
+	clipVertices.resize(vertexTotal);
+	pool.parallelFor(vertexTotal, 1024, [&](size_t begin, size_t end)
+	{
+		size_t d = std::upper_bound(draws.begin(), draws.end(), begin, [](size_t value, const Draw& draw) { return value < draw.clipBase; }) - draws.begin() - 1;
+		for (size_t i = begin; i < end; i++)
+		{
+			while (i >= draws[d].clipBase + draws[d].vertexCount)
+				d++;
+			const Draw& draw = draws[d];
+			const Vertex& vertex = meshes[draw.mesh].vertices[draw.firstVertex + (i - draw.clipBase)];
+			ClipVertex& out = clipVertices[i];
+			out.clip = draw.mvp * glm::vec4(vertex.position, 1.0f);
+			if (!draw.lit)
+				continue;
+			glm::vec3 world = glm::vec3(draw.model * glm::vec4(vertex.position, 1.0f));
+			glm::vec3 normal = draw.normalMatrix * vertex.normal;
+			glm::vec2 uv = vertex.uv * frameUvScale;
+			out.attributes[ATTRIBUTE_POSITION] = world.x;
+			out.attributes[ATTRIBUTE_POSITION + 1] = world.y;
+			out.attributes[ATTRIBUTE_POSITION + 2] = world.z;
+			out.attributes[ATTRIBUTE_NORMAL] = normal.x;
+			out.attributes[ATTRIBUTE_NORMAL + 1] = normal.y;
+			out.attributes[ATTRIBUTE_NORMAL + 2] = normal.z;
+			out.attributes[ATTRIBUTE_UV] = uv.x;
+			out.attributes[ATTRIBUTE_UV + 1] = uv.y;
+		}
+	});
+	vertexTime = millisecondsSince(start);
+	start = std::chrono::steady_clock::now();
+
+	// Setup and binning: each chunk keeps its own triangles and tile lists, so no thread
+	// waits on another and tiles see triangles in submission order
+	size_t tileCount = (size_t)tilesX * tilesY;
+	size_t parts = (size_t)pool.size() * 4;
+	size_t grain = std::max(MIN_BIN_GRAIN, (triangleCount + parts - 1) / parts);
+	activeChunks = (triangleCount + grain - 1) / grain;
+	if (chunks.size() < activeChunks)
+		chunks.resize(activeChunks);
+	for (size_t c = 0; c < activeChunks; c++)
+	{
+		chunks[c].triangles.clear();
+		chunks[c].tiles.resize(tileCount);
+		for (size_t tile = 0; tile < tileCount; tile++)
+			chunks[c].tiles[tile].clear();
+	}
+	pool.parallelFor(triangleCount, grain, [&](size_t begin, size_t end)
+	{
+		BinChunk& chunk = chunks[begin / grain];
+		size_t d = std::upper_bound(draws.begin(), draws.end(), begin, [](size_t value, const Draw& draw) { return value < draw.triangleBase; }) - draws.begin() - 1;
+		for (size_t t = begin; t < end; t++)
+		{
+			while (t >= draws[d].triangleBase + draws[d].indexCount / 3)
+				d++;
+			const Draw& draw = draws[d];
+			const GLuint* indices = &meshes[draw.mesh].indices[draw.firstIndex + 3 * (t - draw.triangleBase)];
+			const ClipVertex* triangle[3];
+			for (int k = 0; k < 3; k++)
+				triangle[k] = &clipVertices[draw.clipBase + indices[k] - draw.firstVertex];
+
+			// Wholly outside one side of the view volume
+			const glm::vec4& c0 = triangle[0]->clip;
+			const glm::vec4& c1 = triangle[1]->clip;
+			const glm::vec4& c2 = triangle[2]->clip;
+			if ((c0.x > c0.w && c1.x > c1.w && c2.x > c2.w) || (c0.x < -c0.w && c1.x < -c1.w && c2.x < -c2.w)
+				|| (c0.y > c0.w && c1.y > c1.w && c2.y > c2.w) || (c0.y < -c0.w && c1.y < -c1.w && c2.y < -c2.w)
+				|| (c0.z > c0.w && c1.z > c1.w && c2.z > c2.w) || (c0.z < -c0.w && c1.z < -c1.w && c2.z < -c2.w))
+				continue;
+
+			if (c0.z >= -c0.w && c1.z >= -c1.w && c2.z >= -c2.w)
+				setupTriangle(triangle[0], triangle[1], triangle[2], (GLuint)d, chunk);
+			else
+			{
+				ClipVertex polygon[4];
+				int count = clipNear(triangle, polygon);
+				for (int k = 1; k + 1 < count; k++)
+					setupTriangle(&polygon[0], &polygon[k], &polygon[k + 1], (GLuint)d, chunk);
+			}
+		}
+	});
+	triangleTotal = 0;
+	for (size_t c = 0; c < activeChunks; c++)
+		triangleTotal += chunks[c].triangles.size();
+	binTime = millisecondsSince(start);
+	start = std::chrono::steady_clock::now();
+
+	// Raster stage: tiles are claimed one at a time, so busy tiles do not hold up the rest
+	pool.parallelFor(tileCount, 1, [this](size_t begin, size_t end)
+	{
+		for (size_t tile = begin; tile < end; tile++)
+			rasterizeTile((int)tile);
+	});
+	rasterTime = millisecondsSince(start);
+}
+
+// Sutherland-Hodgman against z = -w; a triangle comes out as up to 4 vertices
+int SoftwareRasterizer::clipNear(const ClipVertex* const triangle[3], ClipVertex* polygon)
+{
+	int count = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const ClipVertex& a = *triangle[i];
+		const ClipVertex& b = *triangle[(i + 1) % 3];
+		float da = a.clip.z + a.clip.w, db = b.clip.z + b.clip.w;
+		if (da >= 0.0f)
+			polygon[count++] = a;
+		if ((da >= 0.0f) != (db >= 0.0f))
+		{
+			float t = da / (da - db);
+			ClipVertex& crossing = polygon[count++];
+			crossing.clip = a.clip + (b.clip - a.clip) * t;
+			for (int j = 0; j < ATTRIBUTE_COUNT; j++)
+				crossing.attributes[j] = a.attributes[j] + (b.attributes[j] - a.attributes[j]) * t;
+		}
+	}
+	return count;
+}
+
+void SoftwareRasterizer::setupTriangle(const ClipVertex* v0, const ClipVertex* v1, const ClipVertex* v2, GLuint draw, BinChunk& chunk)
+{
+	const ClipVertex* v[3] = { v0, v1, v2 };
+	float x[3], y[3], z[3], invW[3];
+	for (int k = 0; k < 3; k++)
+	{
+		invW[k] = 1.0f / v[k]->clip.w;
+		x[k] = (v[k]->clip.x * invW[k] * 0.5f + 0.5f) * frameWidth;
+		y[k] = (v[k]->clip.y * invW[k] * 0.5f + 0.5f) * frameHeight;
+		z[k] = v[k]->clip.z * invW[k] * 0.5f + 0.5f;
+	}
+
+	// Drawn two-sided like the GL path, so clockwise triangles are flipped rather than skipped
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area < 0.0f)
+	{
+		std::swap(v[1], v[2]);
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+		std::swap(invW[1], invW[2]);
+		area = -area;
+	}
+	if (!(area > 1e-8f))
+		return;
+
+	// Pixels whose centres fall in the triangle's box, clamped to the frame before converting
+	float minX = std::max(0.0f, ceilf(std::min(x[0], std::min(x[1], x[2])) - 0.5f));
+	float maxX = std::min((float)(frameWidth - 1), floorf(std::max(x[0], std::max(x[1], x[2])) - 0.5f));
+	float minY = std::max(0.0f, ceilf(std::min(y[0], std::min(y[1], y[2])) - 0.5f));
+	float maxY = std::min((float)(frameHeight - 1), floorf(std::max(y[0], std::max(y[1], y[2])) - 0.5f));
+	if (!(minX <= maxX && minY <= maxY))
+		return;
+
+	chunk.triangles.push_back(SetupTriangle());
+	SetupTriangle& triangle = chunk.triangles.back();
+	triangle.minX = (int)minX;
+	triangle.maxX = (int)maxX;
+	triangle.minY = (int)minY;
+	triangle.maxY = (int)maxY;
+	triangle.draw = draw;
+
+	// edges[0] weights v0, edges[1] v1 and edges[2] v2; each is positive inside
+	for (int k = 0; k < 3; k++)
+	{
+		int p = (k + 1) % 3, q = (k + 2) % 3;
+		float a = y[p] - y[q], b = x[q] - x[p];
+		triangle.edges[k][0] = a;
+		triangle.edges[k][1] = b;
+		triangle.edges[k][2] = -a * x[p] - b * y[p];
+	}
+
+	// Every interpolated value is a plane over the screen: depth directly, the attributes
+	// divided by w so dividing by the interpolated 1/w makes them perspective-correct
+	float invArea = 1.0f / area;
+	int planeCount = draws[draw].lit ? LIT_PLANE_COUNT : PLANE_DEPTH + 1;
+	for (int plane = 0; plane < planeCount; plane++)
+	{
+		float value[3];
+		for (int k = 0; k < 3; k++)
+		{
+			if (plane == PLANE_DEPTH)
+				value[k] = z[k];
+			else if (plane == PLANE_INV_W)
+				value[k] = invW[k];
+			else
+				value[k] = v[k]->attributes[plane - PLANE_ATTRIBUTES] * invW[k];
+		}
+		for (int coefficient = 0; coefficient < 3; coefficient++)
+		{
+			triangle.planes[plane][coefficient] = (triangle.edges[0][coefficient] * value[0] + triangle.edges[1][coefficient] * value[1]
+				+ triangle.edges[2][coefficient] * value[2]) * invArea;
+		}
+	}
+
+	uint32_t id = (uint32_t)chunk.triangles.size() - 1;
+	for (int tileY = triangle.minY / RASTER_TILE_SIZE; tileY <= triangle.maxY / RASTER_TILE_SIZE; tileY++)
+	{
+		for (int tileX = triangle.minX / RASTER_TILE_SIZE; tileX <= triangle.maxX / RASTER_TILE_SIZE; tileX++)
+			chunk.tiles[tileY * tilesX + tileX].push_back(id);
+	}
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile)
+{
+	int tileX = tile % tilesX, tileY = tile / tilesX;
+	int x0 = tileX * RASTER_TILE_SIZE, x1 = std::min(x0 + RASTER_TILE_SIZE, frameWidth);
+	int y0 = tileY * RASTER_TILE_SIZE, y1 = std::min(y0 + RASTER_TILE_SIZE, frameHeight);
+
+	// The last column of tiles also owns the row padding
+	int clearEnd = tileX == tilesX - 1 ? frameStride : x1;
+	for (int y = y0; y < y1; y++)
+	{
+		std::fill(color.begin() + (size_t)y * frameStride + x0, color.begin() + (size_t)y * frameStride + clearEnd, clearValue);
+		std::fill(depth.begin() + (size_t)y * frameStride + x0, depth.begin() + (size_t)y * frameStride + clearEnd, 1.0f);
+	}
+
+	for (size_t c = 0; c < activeChunks; c++)
+	{
+		const BinChunk& chunk = chunks[c];
+		const std::vector<uint32_t>& bin = chunk.tiles[tile];
+		for (size_t i = 0; i < bin.size(); i++)
+			rasterizeTriangle(chunk.triangles[bin[i]], x0, x1, y0, y1);
+	}
+}
+
+void SoftwareRasterizer::rasterizeTriangle(const SetupTriangle& triangle, int x0, int x1, int y0, int y1)
+{
+	int minX = std::max(triangle.minX, x0), maxX = std::min(triangle.maxX, x1 - 1);
+	int minY = std::max(triangle.minY, y0), maxY = std::min(triangle.maxY, y1 - 1);
+	if (minX > maxX || minY > maxY)
+		return;
+
+	const Draw& draw = draws[triangle.draw];
+	ShadeContext context = { texture.data(), textureWidth, textureHeight, eye, frameLights, frameLightCount, draw.color };
+	uint32_t flatColor = packColor(draw.color.x, draw.color.y, draw.color.z, draw.color.w);
+	int planeCount = draw.lit ? LIT_PLANE_COUNT : PLANE_DEPTH + 1;
+	const float (*edges)[3] = triangle.edges;
+	const float (*planes)[3] = triangle.planes;
+
+	// Groups of 4 start on a multiple of 4; tiles do too, so a group never leaves its tile
+	minX &= ~3;
+	for (int y = minY; y <= maxY; y++)
+	{
+		uint32_t* colorRow = &color[(size_t)y * frameStride];
+		float* depthRow = &depth[(size_t)y * frameStride];
+		float py = y + 0.5f;
+		int x = minX;
+#ifdef RASTER_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 rowEdges[3], rowPlanes[LIT_PLANE_COUNT];
+		for (int k = 0; k < 3; k++)
+			rowEdges[k] = _mm_set1_ps(edges[k][1] * py + edges[k][2]);
+		for (int k = 0; k < planeCount; k++)
+			rowPlanes[k] = _mm_set1_ps(planes[k][1] * py + planes[k][2]);
+		for (; x <= maxX; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[0][0]), px), rowEdges[0]);
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[1][0]), px), rowEdges[1]);
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[2][0]), px), rowEdges[2]);
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[PLANE_DEPTH][0]), px), rowPlanes[PLANE_DEPTH]);
+			__m128 oldDepth = _mm_loadu_ps(depthRow + x);
+			__m128 write = _mm_and_ps(inside, _mm_cmplt_ps(z, oldDepth));
+			if (_mm_movemask_ps(write) == 0)
+				continue;
+			_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(write, z), _mm_andnot_ps(write, oldDepth)));
+
+			__m128i shaded;
+			if (draw.lit)
+			{
+				__m128 invW = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[PLANE_INV_W][0]), px), rowPlanes[PLANE_INV_W]);
+				__m128 w = _mm_div_ps(_mm_set1_ps(1.0f), invW);
+				__m128 attributes[ATTRIBUTE_COUNT];
+				for (int k = 0; k < ATTRIBUTE_COUNT; k++)
+				{
+					int plane = PLANE_ATTRIBUTES + k;
+					attributes[k] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[plane][0]), px), rowPlanes[plane]), w);
+				}
+				shaded = shadeQuad(context, attributes);
+			}
+			else
+				shaded = _mm_set1_epi32((int)flatColor);
+			__m128i mask = _mm_castps_si128(write);
+			__m128i oldColor = _mm_loadu_si128((const __m128i*)(colorRow + x));
+			_mm_storeu_si128((__m128i*)(colorRow + x), _mm_or_si128(_mm_and_si128(mask, shaded), _mm_andnot_si128(mask, oldColor)));
+		}
+#endif
+		for (; x <= maxX; x++)
+		{
+			float px = x + 0.5f;
+			if (edges[0][0] * px + (edges[0][1] * py + edges[0][2]) < 0.0f || edges[1][0] * px + (edges[1][1] * py + edges[1][2]) < 0.0f
+				|| edges[2][0] * px + (edges[2][1] * py + edges[2][2]) < 0.0f)
+				continue;
+			float z = planes[PLANE_DEPTH][0] * px + (planes[PLANE_DEPTH][1] * py + planes[PLANE_DEPTH][2]);
+			if (!(z < depthRow[x]))
+				continue;
+			depthRow[x] = z;
+			if (!draw.lit)
+			{
+				colorRow[x] = flatColor;
+				continue;
+			}
+			float w = 1.0f / (planes[PLANE_INV_W][0] * px + (planes[PLANE_INV_W][1] * py + planes[PLANE_INV_W][2]));
+			float attributes[ATTRIBUTE_COUNT];
+			for (int k = 0; k < ATTRIBUTE_COUNT; k++)
+			{
+				const float* plane = planes[PLANE_ATTRIBUTES + k];
+				attributes[k] = (plane[0] * px + (plane[1] * py + plane[2])) * w;
+			}
+			colorRow[x] = shadePixel(context, attributes);
+		}
+	}
+}
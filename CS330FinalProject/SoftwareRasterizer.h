@@ -0,0 +1,132 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+#include "ClusteredLights.h"
+#include "ShapeData.h"
+
+// Edge of the square screen tiles that triangles are binned into; one thread rasterizes a tile
+const int RASTER_TILE_SIZE = 64;
+// Lights beyond this many are ignored
+const int RASTER_MAX_LIGHTS = 4;
+
+// CPU backend that draws the scene into an in-memory framebuffer from the same meshes, texture
+// and camera as the GL path. Vertices are transformed in parallel, triangles are clipped
+// against the near plane and binned into screen tiles, and each tile is rasterized by one
+// thread, four pixels at a time with SSE. Lit draws follow the Phong program and flat draws
+// the lamp program. Every light is treated as unbounded, which covers the key and fill lights.
+class SoftwareRasterizer
+{
+public:
+	SoftwareRasterizer();
+
+	// Copies the mesh's vertices and indices; the returned id is passed to drawLit/drawFlat
+	int addMesh(const ShapeData& shape);
+	// Rows bottom to top as uploaded to GL, 3 or 4 channels; sampled bilinearly with repeat
+	void setTexture(const unsigned char* pixels, int width, int height, int channels);
+
+	void beginFrame(int width, int height, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition,
+		const PointLight* lights, int lightCount, const glm::vec2& uvScale, const glm::vec4& clearColor);
+	// Textured and lit like the Phong program
+	void drawLit(int mesh, GLuint firstIndex, GLuint indexCount, const glm::mat4& model, const glm::vec4& color = glm::vec4(1.0f));
+	// Flat color like the lamp program
+	void drawFlat(int mesh, GLuint firstIndex, GLuint indexCount, const glm::mat4& model, const glm::vec4& color = glm::vec4(1.0f));
+	void render();
+
+	// RGBA8 with rows bottom to top like glReadPixels, stride() pixels apart
+	const uint32_t* colorBuffer() const { return color.data(); }
+	int width() const { return frameWidth; }
+	int height() const { return frameHeight; }
+	int stride() const { return frameStride; }
+
+	// Counters of the last render()
+	size_t rasterizedTriangles() const { return triangleTotal; }
+	double vertexMilliseconds() const { return vertexTime; }
+	double binMilliseconds() const { return binTime; }
+	double rasterMilliseconds() const { return rasterTime; }
+
+private:
+	struct ClipVertex
+	{
+		glm::vec4 clip;
+		float attributes[8];    // World position, world normal, texture coordinate
+	};
+
+	// Screen-space triangle ready for any tile: edge functions and the planes of every
+	// interpolated value, so tiles never repeat the setup
+	struct SetupTriangle
+	{
+		float edges[3][3];      // a, b, c of the edges opposite v0, v1 and v2
+		float planes[10][3];    // Depth, 1/w, then the attributes divided by w
+		int minX, maxX, minY, maxY;
+		GLuint draw;
+	};
+
+	struct Mesh
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::map<std::pair<GLuint, GLuint>, std::pair<GLuint, GLuint> > rangeVertices; // index range -> first and last vertex used
+	};
+
+	struct Draw
+	{
+		int mesh;
+		GLuint firstIndex;
+		GLuint indexCount;
+		GLuint firstVertex;     // Lowest vertex the range uses
+		GLuint vertexCount;
+		size_t clipBase;        // Where its transformed vertices start
+		size_t triangleBase;
+		glm::mat4 mvp;
+		glm::mat4 model;
+		glm::mat3 normalMatrix;
+		glm::vec4 color;
+		bool lit;
+	};
+
+	// Triangles set up by one chunk of the binning pass, with per-tile lists into them
+	struct BinChunk
+	{
+		std::vector<SetupTriangle> triangles;
+		std::vector<std::vector<uint32_t> > tiles;
+	};
+
+	static int clipNear(const ClipVertex* const triangle[3], ClipVertex* polygon);
+	void addDraw(int mesh, GLuint firstIndex, GLuint indexCount, const glm::mat4& model, const glm::vec4& color, bool lit);
+	void setupTriangle(const ClipVertex* v0, const ClipVertex* v1, const ClipVertex* v2, GLuint draw, BinChunk& chunk);
+	void rasterizeTile(int tile);
+	void rasterizeTriangle(const SetupTriangle& triangle, int x0, int x1, int y0, int y1);
+
+	std::vector<Mesh> meshes;
+	std::vector<uint32_t> texture;
+	int textureWidth;
+	int textureHeight;
+
+	int frameWidth;
+	int frameHeight;
+	int frameStride;
+	int tilesX;
+	int tilesY;
+	std::vector<uint32_t> color;
+	std::vector<float> depth;
+	uint32_t clearValue;
+
+	glm::mat4 viewProjection;
+	glm::vec3 eye;
+	PointLight frameLights[RASTER_MAX_LIGHTS];
+	int frameLightCount;
+	glm::vec2 frameUvScale;
+
+	std::vector<Draw> draws;
+	std::vector<ClipVertex> clipVertices;
+	std::vector<BinChunk> chunks;
+	size_t activeChunks;    // Chunks filled by the last binning pass
+	size_t triangleTotal;
+	double vertexTime;
+	double binTime;
+	double rasterTime;
+};
@@ -0,0 +1,115 @@
+#include "ThreadPool.h"
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned threadCount) : pending(0), stopping(false)
+{
+	if (threadCount == 0)
+	{
+		unsigned hardware = std::thread::hardware_concurrency();
+		threadCount = hardware > 1 ? hardware : 1;
+	}
+	// The caller of parallelFor is the last thread
+	for (unsigned i = 1; i < threadCount; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskReady.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0)
+				tasksDone.notify_all();
+		}
+	}
+}
+
+void ThreadPool::submit(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+		pending++;
+	}
+	taskReady.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	tasksDone.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+	size_t chunks = (count + grain - 1) / grain;
+	if (chunks == 1 || workers.empty())
+	{
+		fn(0, count);
+		return;
+	}
+
+	// Every participant claims chunks from a shared counter until none remain
+	std::atomic<size_t> nextChunk(0);
+	std::atomic<size_t> helpersLeft(0);
+	std::mutex doneMutex;
+	std::condition_variable done;
+	auto drain = [&]()
+	{
+		for (size_t chunk = nextChunk++; chunk < chunks; chunk = nextChunk++)
+		{
+			size_t begin = chunk * grain;
+			size_t end = begin + grain < count ? begin + grain : count;
+			fn(begin, end);
+		}
+	};
+
+	size_t helpers = chunks - 1 < workers.size() ? chunks - 1 : workers.size();
+	helpersLeft = helpers;
+	for (size_t i = 0; i < helpers; i++)
+	{
+		submit([&]()
+		{
+			drain();
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--helpersLeft == 0)
+				done.notify_one();
+		});
+	}
+	drain();
+
+	std::unique_lock<std::mutex> lock(doneMutex);
+	done.wait(lock, [&] { return helpersLeft == 0; });
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by the CPU-heavy stages (mesh generation, culling).
+// parallelFor lets the calling thread take part, so it also works with zero workers.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	// Number of threads that run work, including the caller of parallelFor
+	unsigned size() const { return (unsigned)workers.size() + 1; }
+
+	// Runs fn(begin, end) over [0, count) in chunks of at most grain items and returns when all are done
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+	// Queues a task for any worker; wait() blocks until every queued task has finished
+	void submit(const std::function<void()>& task);
+	void wait();
+
+	// Process-wide pool sized to the machine
+	static ThreadPool& shared();
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable taskReady;
+	std::condition_variable tasksDone;
+	size_t pending;
+	bool stopping;
+};
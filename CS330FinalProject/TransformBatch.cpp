@@ -0,0 +1,95 @@
+#include "TransformBatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_BATCH_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef TRANSFORM_BATCH_SSE
+
+namespace
+{
+	// (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0) for w = 0 inputs
+	inline __m128 cross3(__m128 a, __m128 b)
+	{
+		__m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYzx), _mm_mul_ps(aYzx, b));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+
+	inline __m128 dot3Splat(__m128 a, __m128 b)
+	{
+		__m128 m = _mm_mul_ps(a, b);
+		__m128 x = _mm_shuffle_ps(m, m, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+		return _mm_add_ps(_mm_add_ps(x, y), z);
+	}
+
+	// Column j of a * b is a's columns weighted by the components of b's column j
+	inline __m128 transformColumn(const __m128 a[4], __m128 column)
+	{
+		__m128 r = _mm_mul_ps(a[0], _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(a[1], _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(a[2], _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+		return _mm_add_ps(r, _mm_mul_ps(a[3], _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+}
+
+void computeObjectTransforms(const glm::mat4* models, const glm::mat4* positionDecodes, size_t count, const glm::mat4& viewProjection, ObjectTransform* out)
+{
+	__m128 vp[4];
+	for (int c = 0; c < 4; c++)
+		vp[c] = _mm_loadu_ps(&viewProjection[c][0]);
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const float* m = &models[i][0][0];
+		ObjectTransform& t = out[i];
+		__m128 col[4];
+		for (int c = 0; c < 4; c++)
+			col[c] = _mm_loadu_ps(m + c * 4);
+		for (int c = 0; c < 4; c++)
+		{
+			__m128 model = col[c];
+			if (positionDecodes)
+				model = transformColumn(col, _mm_loadu_ps(&positionDecodes[i][c][0]));
+			_mm_storeu_ps(&t.model[c][0], model);
+			_mm_storeu_ps(&t.mvp[c][0], transformColumn(vp, model));
+		}
+
+		// inverse(M)^T of the upper 3x3 has columns (b x c, c x a, a x b) / det
+		__m128 a = _mm_and_ps(col[0], xyzMask);
+		__m128 b = _mm_and_ps(col[1], xyzMask);
+		__m128 c = _mm_and_ps(col[2], xyzMask);
+		__m128 bc = cross3(b, c);
+		__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), dot3Splat(a, bc));
+		_mm_storeu_ps(&t.normalMatrix[0][0], _mm_mul_ps(bc, invDet));
+		_mm_storeu_ps(&t.normalMatrix[1][0], _mm_mul_ps(cross3(c, a), invDet));
+		_mm_storeu_ps(&t.normalMatrix[2][0], _mm_mul_ps(cross3(a, b), invDet));
+	}
+}
+
+#else
+
+void computeObjectTransforms(const glm::mat4* models, const glm::mat4* positionDecodes, size_t count, const glm::mat4& viewProjection, ObjectTransform* out)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::mat4& m = models[i];
+		ObjectTransform& t = out[i];
+		t.model = positionDecodes ? m * positionDecodes[i] : m;
+		t.mvp = viewProjection * t.model;
+
+		glm::vec3 a(m[0]), b(m[1]), c(m[2]);
+		glm::vec3 bc = glm::cross(b, c);
+		float invDet = 1.0f / glm::dot(a, bc);
+		t.normalMatrix[0] = glm::vec4(bc * invDet, 0.0f);
+		t.normalMatrix[1] = glm::vec4(glm::cross(c, a) * invDet, 0.0f);
+		t.normalMatrix[2] = glm::vec4(glm::cross(a, b) * invDet, 0.0f);
+	}
+}
+
+#endif
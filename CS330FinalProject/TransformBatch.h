@@ -0,0 +1,19 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// std430 mirror of the shader's ObjectTransform. The normal matrix is a mat3, which
+// std430 lays out as three 16-byte columns.
+struct ObjectTransform
+{
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3];  // inverse-transpose of the model's upper 3x3
+	glm::mat4 mvp;
+	glm::vec4 color;
+};
+
+// Fills model, normal matrix and MVP for a batch of objects sharing one view-projection.
+// Colors are left untouched. When positionDecodes is given, each object's decode (quantized
+// vertex position to mesh space) is folded into its model and MVP; the normal matrix is still
+// taken from the plain model because normals are not stored relative to the mesh bounds.
+void computeObjectTransforms(const glm::mat4* models, const glm::mat4* positionDecodes, size_t count, const glm::mat4& viewProjection, ObjectTransform* out);
@@ -0,0 +1,26 @@
+#include "UniformBuffer.h"
+
+void UniformBuffer::create(GLuint binding, GLsizeiptr size)
+{
+	bufferSize = size;
+	glGenBuffers(1, &bufferId);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+	glBufferData(GL_UNIFORM_BUFFER, bufferSize, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, bufferId);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Replaces the whole block in one driver call
+void UniformBuffer::update(const void* data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, bufferSize, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	updates++;
+}
+
+void UniformBuffer::destroy()
+{
+	glDeleteBuffers(1, &bufferId);
+	bufferId = 0;
+}
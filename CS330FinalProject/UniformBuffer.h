@@ -0,0 +1,49 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Binding points shared by every program that declares the matching std140 blocks
+enum UniformBlockBinding
+{
+	FRAME_BLOCK_BINDING = 0,
+	LIGHT_BLOCK_BINDING = 1
+};
+
+// CPU mirror of the FrameData block. std140 aligns each vec3 to 16 bytes,
+// so every vec3 is followed by an explicit float of padding.
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 viewPosition;
+	float pad0;
+};
+
+// CPU mirror of the LightData block describing the clustered light grid
+struct LightUniforms
+{
+	glm::uvec4 clusterGrid;   // x, y and z cluster counts, w = number of unbounded lights
+	glm::vec4 clusterDepth;   // near plane, far plane, depth slice scale, depth slice bias
+	glm::vec2 viewportSize;
+	float pad0;
+	float pad1;
+};
+
+// A uniform buffer bound to a fixed binding point and rewritten with a single upload
+class UniformBuffer
+{
+public:
+	UniformBuffer() : bufferId(0), bufferSize(0), updates(0) {}
+
+	void create(GLuint binding, GLsizeiptr size);
+	void update(const void* data);
+	void destroy();
+
+	GLuint updateCount() const { return updates; }
+	void resetUpdateCount() { updates = 0; }
+
+private:
+	GLuint bufferId;
+	GLsizeiptr bufferSize;
+	GLuint updates;
+};
@@ -11,6 +11,30 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <ShapeGenerator.h>
 #include "ShapeData.h"
+#include "ShaderProgram.h"
+#include "UniformBuffer.h"
+#include "ClusteredLights.h"
+#include "FrameCapture.h"
+#include "Frustum.h"
+#include "GeometryHeap.h"
+#include "IndirectDraws.h"
+#include "InstanceBuffer.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "OcclusionCuller.h"
+#include "OffscreenTarget.h"
+#include "PackedVertex.h"
+#include "ProgramBuilder.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "SoftwareRasterizer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
 
 using namespace std; // Standard namespace
 
@@ -28,14 +52,56 @@ namespace
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
 
+    // Command-line options. Headless runs render into an offscreen target through an EGL or
+    // OSMesa context, with no window or display server, and exit after a fixed number of frames.
+    struct LaunchOptions
+    {
+        bool headless;
+        bool osmesa;            // OSMesa instead of surfaceless EGL; GLEW must be built with GLEW_OSMESA
+        bool software;          // Rasterize on the CPU; GL only shows the finished image
+        int width;
+        int height;
+        int frames;
+        const char* outputPrefix; // Each frame captured to <prefix>_NNNN.tga when set, windowed or headless
+        const char* texturePath;  // Forward slashes work on Windows too
+    };
+    LaunchOptions gOptions = { false, false, false, WINDOW_WIDTH, WINDOW_HEIGHT, 300, nullptr, "../resources/textures/texture.png" };
+    OffscreenTarget gOffscreen;
+    FrameCapture gFrameCapture;
+    // CPU backend with its own copies of the scene and sphere, and the texture its frames are
+    // uploaded to before they are blitted to the window or offscreen target
+    SoftwareRasterizer gSoftware;
+    int gSoftwareScene = -1;
+    int gSoftwareSphere = -1;
+    GLuint gSoftwareTexture = 0;
+    GLuint gSoftwareFramebuffer = 0;
+    int gSoftwareTextureWidth = 0;
+    int gSoftwareTextureHeight = 0;
+    // Headless frames advance the animation by a fixed step so runs are repeatable
+    const float HEADLESS_FRAME_TIME = 1.0f / 60.0f;
+
+    // Current framebuffer size, used to map fragments to light clusters
+    int gViewportWidth = WINDOW_WIDTH;
+    int gViewportHeight = WINDOW_HEIGHT;
+
+    // Projection clip planes, shared with the light cluster depth slicing
+    const float NEAR_PLANE = 0.1f;
+    const float FAR_PLANE = 100.0f;
+    // Half the height of the orthographic view volume
+    const float ORTHO_HALF_SIZE = 2.15f;
+
     // Stores the GL data relative to a given mesh
     struct GLMesh
     {
-        GLuint vao;         // Handle for the vertex array object
-        GLuint vbos[2];     // Handle for the vertex buffer object & EBO
-        GLuint nIndices;    // Number of indices of the mesh
+        GeometryAllocation scene;  // Scene vertices and indices in gGeometry, the mug LODs after the scene's own
+        GeometryAllocation sphere;
+        GLuint nIndices;    // Number of the scene's own indices, before the LODs
         GLuint nLightIndices; // Number of indices to create light sources.
-        GLuint sphereVBO{}, sphereVAO; // Handle for the sphere vbo/vao
+        GLuint culledVAO, sphereCulledVAO; // Heap vertices, with indices streamed by the meshlet cullers
+        glm::mat4 positionDecode;       // Quantized scene positions back to mesh space
+        glm::mat4 spherePositionDecode; // Same for the sphere
+        std::vector<MeshLod> mugLods;   // Full mug first, then coarser index ranges over the same vertices
+        BoundingVolume sceneBounds, mugBounds, lampBounds, sphereBounds; // Mesh space, for frustum culling
     };
 
     // Main GLFW window
@@ -43,6 +109,8 @@ namespace
 
     // Triangle mesh data
     GLMesh gMesh;
+    // One vertex and one index buffer for every static mesh, drawn through one VAO
+    GeometryHeap gGeometry;
 
     // Texture id
     GLuint gTextureId;
@@ -54,6 +122,23 @@ namespace
     GLuint gProgramId;
     GLuint gLampProgramId;
 
+    // Reflected uniform tables for the shader programs
+    ShaderProgram gPhongProgram;
+    ShaderProgram gLampProgram;
+
+    // Uniform handles resolved once after linking
+    struct PhongUniforms
+    {
+        UniformHandle objectColor, uvScale, texture;
+    } gPhongUniforms;
+
+    // Camera and light data shared by every program through std140 blocks
+    UniformBuffer gFrameBuffer;
+    UniformBuffer gLightBuffer;
+
+    // Prints per-frame statistics to the console when enabled
+    bool gShowFrameStats = false;
+
     // Toggles ortho/perspective view
     bool ortho = false;
 
@@ -84,12 +169,87 @@ namespace
     // Lamp animation
     bool gIsLampOrbiting = false;
 
-    // sphere creation variables
-    GLuint sphereNumIndices;
-    GLuint sphereVertexArrayObjectID;
-    GLuint sphereIndexByteOffset;
-    const uint NUM_FLOATS_PER_VERTICE = 9;
-    const uint VERTEX_BYTE_SIZE = NUM_FLOATS_PER_VERTICE * sizeof(float);
+    // Every light in the scene. The key and fill lights are rebuilt at the front each frame.
+    std::vector<PointLight> gLights;
+    LightClusters gLightClusters;
+    // Field of small bounded lights scattered over the table, toggled with 'O'
+    std::vector<PointLight> gLightField;
+    bool gShowLightField = false;
+    const int LIGHT_FIELD_COUNT = 128;
+
+    // Model matrices and colors of every instance drawn this frame
+    InstanceBuffer gInstanceBuffer;
+    // Grid of extra mugs spread over the table, toggled with 'M'
+    bool gShowMugCrowd = false;
+    const int MUG_CROWD_COLUMNS = 48;
+    const int MUG_CROWD_ROWS = 30;
+    // Triangle ratios of the mug LODs, and how far a LOD may stray on screen before a finer one is used
+    const float MUG_LOD_RATIOS[] = { 0.5f, 0.25f, 0.12f };
+    const float LOD_MAX_PIXEL_ERROR = 1.0f;
+    // Crowd mugs grouped by the LOD they drew with this frame
+    struct CrowdLodBatch
+    {
+        std::vector<glm::mat4> models;
+        GLuint firstInstance;
+    };
+    std::vector<CrowdLodBatch> gCrowdLods;
+
+    // Per-meshlet culling of the scene and sphere, toggled with 'C'. Both are frustum culled;
+    // only the closed sphere is also cone culled, since the open mug shows its back faces.
+    MeshletCuller gSceneMeshlets;
+    MeshletCuller gSphereMeshlets;
+    bool gMeshletCulling = true;
+
+    // Heap draws of each program submitted as one multi-draw indirect, or one call per command with 'I'
+    IndirectDrawBuffer gIndirectDraws;
+    bool gMultiDrawIndirect = true;
+    // Every draw of the frame, sorted so programs, textures and VAOs are bound as rarely as possible
+    RenderQueue gRenderQueue;
+
+    // Whole objects are frustum culled by their bounding spheres, packed in this slot order with
+    // the crowd mugs last
+    enum CullSlot { CULL_SCENE, CULL_KEY_LAMP, CULL_FILL_LAMP, CULL_SPHERE, CULL_CROWD };
+    std::vector<BoundingVolume> gCullBounds;
+    std::vector<glm::vec4> gCullSpheres;
+    std::vector<unsigned char> gCullVisible;
+    std::vector<glm::mat4> gCrowdModels;
+
+    // Software depth buffer of the mug and cylinder that rejects objects hidden behind them, toggled with 'H'
+    OcclusionCuller gOcclusion;
+    bool gOcclusionCulling = true;
+
+    // Segments around the mug, handle and cylinder; the one knob for the scene's tessellation
+    const uint MESH_RESOLUTION = 32;
+
+    // Everything UBuildSceneMesh generates the scene from. It reads nothing else, and the scene
+    // cache key hashes these bytes, so editing any value here regenerates the cache. All members
+    // are 4 bytes wide so the struct has no padding.
+    struct SceneMeshSource
+    {
+        GLuint resolution;
+        GLuint planeDimensions;
+        float bodyRadius, bodyHeight;
+        float handleMajorRadius, handleMinorRadius, handleSweep;
+        float cylinderRadius, cylinderHeight;
+        GLuint bodyCaps[2], cylinderCaps[2];        // Bottom and top
+        glm::vec2 uvCells[4][2];                    // Texture atlas cell of the body, handle, plane and cylinder
+        glm::mat4 placements[4];
+        float lodRatios[sizeof(MUG_LOD_RATIOS) / sizeof(MUG_LOD_RATIOS[0])];
+    };
+    // A level 2 icosphere (162 vertices) matches the silhouette of the 400 vertex UV sphere
+    const GLuint SPHERE_SUBDIVISIONS = 2;
+
+    // Generated meshes are cached here between launches, keyed by the inputs that shape them
+    const char* const SCENE_CACHE_PATH = "scene.meshcache";
+    const char* const SPHERE_CACHE_PATH = "sphere.meshcache";
+
+    // Linked shader programs from earlier launches, stored next to the mesh caches
+    ProgramCache gProgramCache;
+    const char* const PROGRAM_CACHE_PREFIX = "program_";
+    // Compiles every program at once while the meshes and texture load
+    ProgramBuilder gProgramBuilder;
+    // Objects of the combined scene mesh, in the order of its part table
+    enum ScenePart { SCENE_PART_LAMP, SCENE_PART_MUG, SCENE_PART_PLANE, SCENE_PART_CYLINDER, SCENE_PART_COUNT };
 }
 
 /* User-defined Function prototypes to:
@@ -97,43 +257,78 @@ namespace
  * redraw graphics on the window when resized,
  * and render graphics on the screen
  */
+bool UParseArguments(int argc, char* argv[], LaunchOptions& options);
 bool UInitialize(int, char* [], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void UCreateMesh(GLMesh& mesh);
+bool UCreateMesh(GLMesh& mesh);
+SceneMeshSource USceneMeshSource();
+void UBuildSceneMesh(const SceneMeshSource& source, ShapeData& scene, std::vector<MeshLod>& mugLods, std::vector<MeshPart>& parts, MeshArena& arena);
+void UBuildSphereMesh(ShapeData& sphere, MeshArena& arena);
+void UOptimizeMesh(ShapeData& shape, const char* name, const GLuint* drawRangeEnds, int drawRangeCount);
 void UDestroyMesh(GLMesh& mesh);
+float ULodPixelsPerUnit(const glm::mat4& model);
+glm::vec3 UModelSpaceEye(const glm::mat4& model);
 bool UCreateTexture(const char* filename, GLuint& textureId);
 void UDestroyTexture(GLuint textureId);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
+void UReflectShaderPrograms();
+void UReportFrameStats();
+void UCreateUniformBuffers();
+void UDestroyUniformBuffers();
+void UUpdateUniformBuffers(const glm::mat4& view, const glm::mat4& projection);
+void UCreateLightField();
+void UUpdateLights(const glm::mat4& view, const glm::mat4& projection);
+void UKeyAndFillLights(PointLight lights[2]);
+void URenderSoftware(const glm::mat4& view, const glm::mat4& projection, const glm::mat4& model, const glm::mat4& sphereModel,
+    const glm::mat4 lampModels[2], bool sceneVisible, bool sphereVisible);
+void UPresentSoftwareFrame();
 
 
 /* Vertex Shader Source Code*/
 const GLchar* vertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0
-layout(location = 1) in vec3 normal; // VAP position 1 for normals
+    layout(location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0, 0..1 within the mesh bounds
+layout(location = 1) in vec2 packedNormal; // VAP position 1 for octahedral-encoded normals
 layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in uint objectIndex; // Per-instance index into ObjectTransforms
 
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate; // For mapping texture to vertex locations
+out vec4 vertexColor; // For outgoing instance tint
 
-//Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-object transforms computed once on the CPU, so no vertex rebuilds the MVP or inverts the model
+struct ObjectTransform
+{
+    mat4 model;
+    mat3 normalMatrix;
+    mat4 mvp;
+    vec4 color;
+};
+layout(std430, binding = 5) readonly buffer ObjectTransforms { ObjectTransform objects[]; };
+
+// Unfolds an octahedral-encoded unit vector
+vec3 octahedralDecode(vec2 encoded)
+{
+    vec3 n = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-n.z, 0.0f);
+    n.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(n.xy, vec2(0.0f)));
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // transforms vertices to clip coordinates
+    ObjectTransform object = objects[objectIndex];
+    gl_Position = object.mvp * vec4(position, 1.0f); // transforms vertices to clip coordinates
     vertexTextureCoordinate = textureCoordinate;
 
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexFragmentPos = vec3(object.model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+    vertexNormal = object.normalMatrix * octahedralDecode(packedNormal); // get normal vectors in world space only and exclude normal translation properties
+    vertexColor = object.color;
 }
 );
 
@@ -143,62 +338,100 @@ const GLchar* fragmentShaderSource = GLSL(440,
     in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
+in vec4 vertexColor; // For incoming instance tint
 
 out vec4 fragmentColor;
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
+// Uniform / Global variables for object color and texture
 uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 viewPosition;
 uniform sampler2D uTexture;
 uniform vec2 uvScale;
-uniform vec3 fillLightColor;
-uniform vec3 fillLightPos;
 
-void main()
+// Camera view matrix and position, updated once per frame
+layout(std140, binding = 0) uniform FrameData
 {
-    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+};
 
-    //Calculate Ambient lighting*/
-    float ambientStrength = 0.2f; // Set ambient or global lighting strength
-    vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
+// Froxel grid layout for the clustered light lists, updated once per frame
+layout(std140, binding = 1) uniform LightData
+{
+    uvec4 clusterGrid; // x, y and z cluster counts, w = number of unbounded lights
+    vec4 clusterDepth; // near plane, far plane, depth slice scale, depth slice bias
+    vec2 viewportSize;
+};
+
+// Every light in the scene; a radius of zero means the light reaches every fragment
+struct PointLight
+{
+    vec3 position;
+    float radius;
+    vec3 color;
+    float ambientStrength;
+};
+layout(std430, binding = 2) readonly buffer LightList { PointLight lights[]; };
+layout(std430, binding = 3) readonly buffer LightClusterGrid { uvec2 clusters[]; }; // first index and count per froxel
+layout(std430, binding = 4) readonly buffer LightIndexList { uint lightIndices[]; }; // unbounded lights first, then per-froxel lists
+
+const float specularIntensity = 0.3f; // Set specular light strength
+const float highlightSize = 1.0f; // Set specular highlight size
+
+/*Phong lighting model calculations to generate ambient, diffuse, and specular components for one light*/
+vec3 phongLight(PointLight light, vec3 norm, vec3 viewDir)
+{
+    vec3 toLight = light.position - vertexFragmentPos;
 
-    // Calculate Ambient lighting for fill light
-    float fillAmbientStrength = 0.2f;
-    vec3 fillAmbient = fillAmbientStrength * fillLightColor;
+    // Smooth window so bounded lights reach exactly zero at their radius
+    float attenuation = 1.0f;
+    if (light.radius > 0.0f)
+    {
+        float falloff = clamp(1.0f - pow(length(toLight) / light.radius, 4.0f), 0.0f, 1.0f);
+        attenuation = falloff * falloff;
+    }
+
+    //Calculate Ambient lighting*/
+    vec3 ambient = light.ambientStrength * light.color; // Generate ambient light color
 
     //Calculate Diffuse lighting*/
-    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+    vec3 lightDirection = normalize(toLight); // Calculate distance (light direction) between light source and fragments/pixels on cube
     float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * lightColor; // Generate diffuse light color
-
-    //Calculate Diffuse lighting for fill
-    vec3 fillLightDirection = normalize(fillLightPos - vertexFragmentPos);
-    float fillImpact = max(dot(norm, fillLightDirection), 0.0);
-    vec3 fillDiffuse = fillImpact * fillLightColor; // Generate diffuse light color
+    vec3 diffuse = impact * light.color; // Generate diffuse light color
 
     //Calculate Specular lighting*/
-    float specularIntensity = 0.3f; // Set specular light strength
-    float highlightSize = 1.0f; // Set specular highlight size
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
     vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-    //Calculate specular component
     float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * lightColor;
+    vec3 specular = specularIntensity * specularComponent * light.color;
+
+    return ambient + (diffuse + specular) * attenuation;
+}
 
-    // Calculate Specular fill lighting
-    float fillSpecularIntensity = 0.3f;
-    vec3 fillReflectDir = reflect(-fillLightDirection, norm);// Calculate reflection vector
-    float fillSpecularComponent = pow(max(dot(viewDir, fillReflectDir), 0.0), highlightSize);
-    vec3 fillSpecular = fillSpecularIntensity * fillSpecularComponent * fillLightColor;
+void main()
+{
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+
+    // Unbounded lights (the key and fill light) sit at the front of the index list
+    vec3 lighting = vec3(0.0f);
+    for (uint i = 0u; i < clusterGrid.w; i++)
+        lighting += phongLight(lights[lightIndices[i]], norm, viewDir);
+
+    // Locate this fragment's froxel from its screen position and view-space depth
+    float viewDepth = max(-(view * vec4(vertexFragmentPos, 1.0f)).z, clusterDepth.x);
+    uvec2 tile = uvec2(clamp(gl_FragCoord.xy / viewportSize, 0.0f, 0.9999f) * vec2(clusterGrid.xy));
+    uint slice = uint(clamp(log(viewDepth) * clusterDepth.z - clusterDepth.w, 0.0f, float(clusterGrid.z - 1u)));
+    uvec2 cluster = clusters[tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)];
+
+    // Only the lights binned into this froxel are evaluated
+    for (uint i = 0u; i < cluster.y; i++)
+        lighting += phongLight(lights[lightIndices[cluster.x + i]], norm, viewDir);
 
     // Texture holds the color to be used for all three components
     vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
 
     // Calculate phong result
-    vec3 phong = (ambient + diffuse + specular + fillAmbient + fillDiffuse + fillSpecular) * textureColor.xyz;
+    vec3 phong = lighting * textureColor.xyz * vertexColor.rgb;
 
     fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
 }
@@ -208,15 +441,24 @@ void main()
 const GLchar* lampVertexShaderSource = GLSL(440,
 
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 3) in uint objectIndex; // Per-instance index into ObjectTransforms
 
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+out vec4 lampColor;
+
+// Same per-object records as the Phong program
+struct ObjectTransform
+{
+    mat4 model;
+    mat3 normalMatrix;
+    mat4 mvp;
+    vec4 color;
+};
+layout(std430, binding = 5) readonly buffer ObjectTransforms { ObjectTransform objects[]; };
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    gl_Position = objects[objectIndex].mvp * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    lampColor = objects[objectIndex].color;
 }
 );
 
@@ -224,11 +466,13 @@ void main()
 /* Lamp Fragment Shader Source Code*/
 const GLchar* lampFragmentShaderSource = GLSL(440,
 
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+    in vec4 lampColor; // For incoming per-instance lamp color
+
+out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
 
 void main()
 {
-    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
+    fragmentColor = lampColor; // White (1.0f,1.0f,1.0f) with alpha 1.0 unless the instance says otherwise
 }
 );
 
@@ -253,40 +497,100 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
 
 int main(int argc, char* argv[])
 {
+    if (!UParseArguments(argc, argv, gOptions))
+        return EXIT_FAILURE;
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
-    // Create the mesh
-    UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
+    // Submit the shader programs first so the driver compiles them while the assets load.
+    // Cached binaries for this driver skip compiling altogether.
+    gProgramCache.create(PROGRAM_CACHE_PREFIX);
+    gProgramBuilder.create(&gProgramCache);
+    gProgramId = gProgramBuilder.submit(vertexShaderSource, fragmentShaderSource);
+    gLampProgramId = gProgramBuilder.submit(lampVertexShaderSource, lampFragmentShaderSource);
 
-    // Create the shader programs
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
-        return EXIT_FAILURE;
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    // Create the mesh
+    if (!UCreateMesh(gMesh)) // Calls the function to create the Vertex Buffer Object
         return EXIT_FAILURE;
 
+    // Feed per-instance transforms to every VAO from one shared buffer
+    gInstanceBuffer.create();
+    gInstanceBuffer.attach(gGeometry.vao());
+    gInstanceBuffer.attach(gMesh.culledVAO);
+    gInstanceBuffer.attach(gMesh.sphereCulledVAO);
+
+    // Stream index buffers for the meshlets that survive culling
+    gSceneMeshlets.create();
+    gSceneMeshlets.attach(gMesh.culledVAO);
+    gSphereMeshlets.create();
+    gSphereMeshlets.attach(gMesh.sphereCulledVAO);
+
+    gIndirectDraws.create();
+
+    // Create the camera and light blocks shared by both programs
+    UCreateUniformBuffers();
+
+    // Create the light cluster storage and the optional field of point lights
+    gLightClusters.create();
+    UCreateLightField();
+
     // Load texture
-    const char* texFilename = "..\\resources\\textures\\texture.png";
+    const char* texFilename = gOptions.texturePath;
     if (!UCreateTexture(texFilename, gTextureId))
     {
         cout << "Failed to load texture " << texFilename << endl;
         return EXIT_FAILURE;
     }
+
+    // Assets are in; only now wait for whatever the compiler has not finished
+    int stillCompiling = gProgramBuilder.poll();
+    if (!gProgramBuilder.finish())
+        return EXIT_FAILURE;
+    cout << "INFO: Shader programs: " << stillCompiling << " still compiling after the assets loaded, waited "
+        << gProgramBuilder.waitMilliseconds() << " ms (" << (gProgramBuilder.isParallel() ? "parallel" : "serial") << " compile)" << endl;
+    if (gProgramCache.isEnabled())
+    {
+        cout << "INFO: Program cache: " << gProgramCache.hitCount() << " hits, " << gProgramCache.missCount() << " misses ("
+            << gProgramCache.rejectedCount() << " rejected by the driver), " << gProgramCache.storedCount() << " stored" << endl;
+    }
+    else
+        cout << "INFO: Program cache off, the driver offers no program binary formats" << endl;
+
+    // Look up every uniform once so the render loop never queries the driver by name
+    UReflectShaderPrograms();
+
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
     glUseProgram(gProgramId);
     // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+    gPhongProgram.set(gPhongUniforms.texture, 0);
 
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // Headless frames go to an offscreen target at the requested size
+    if (gOptions.headless)
+    {
+        if (!gOffscreen.create(gOptions.width, gOptions.height))
+        {
+            cout << "ERROR: Offscreen framebuffer " << gOptions.width << "x" << gOptions.height << " is incomplete" << endl;
+            return EXIT_FAILURE;
+        }
+        gOffscreen.bind();
+        gViewportWidth = gOptions.width;
+        gViewportHeight = gOptions.height;
+    }
+    if (gOptions.outputPrefix)
+        gFrameCapture.create(gOptions.outputPrefix);
+    int frameCount = 0;
+    std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(gWindow))
     {
         // per-frame timing
         // --------------------
-        float currentFrame = glfwGetTime();
+        float currentFrame = gOptions.headless ? gLastFrame + HEADLESS_FRAME_TIME : (float)glfwGetTime();
         gDeltaTime = currentFrame - gLastFrame;
         gLastFrame = currentFrame;
 
@@ -294,16 +598,58 @@ int main(int argc, char* argv[])
 
         // input
         // -----
-        UProcessInput(gWindow);
+        if (!gOptions.headless)
+            UProcessInput(gWindow);
 
         // Render this frame
+        gPhongProgram.beginFrame();
+        gLampProgram.beginFrame();
+        gFrameBuffer.resetUpdateCount();
+        gLightBuffer.resetUpdateCount();
         URender();
+        UReportFrameStats();
+
+        // Read back before the swap; the files are written in the background
+        if (gOptions.outputPrefix)
+            gFrameCapture.capture(frameCount, gViewportWidth, gViewportHeight);
+
+        if (gOptions.headless)
+        {
+            if (frameCount + 1 >= gOptions.frames)
+                glfwSetWindowShouldClose(gWindow, true);
+        }
+        else
+            glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+        frameCount++;
 
         glfwPollEvents();
     }
 
+    // Headless runs double as perf runs
+    if (gOptions.headless)
+    {
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+        cout << "INFO: Rendered " << frameCount << " frames at " << gOptions.width << "x" << gOptions.height << " in "
+            << seconds << " s (" << seconds * 1000.0 / frameCount << " ms per frame)" << endl;
+        gOffscreen.destroy();
+    }
+    if (gOptions.outputPrefix)
+    {
+        gFrameCapture.destroy();
+        cout << "INFO: Captured " << gFrameCapture.writtenFrames() << " frames (" << gFrameCapture.failedFrames() << " failed), "
+            << gFrameCapture.stallCount() << " stalls on a full ring, " << gFrameCapture.captureMilliseconds()
+            << " ms per frame on the render thread" << endl;
+    }
+
     // Release mesh data
     UDestroyMesh(gMesh);
+    gInstanceBuffer.destroy();
+    gSceneMeshlets.destroy();
+    gSphereMeshlets.destroy();
+    gIndirectDraws.destroy();
+    glDeleteFramebuffers(1, &gSoftwareFramebuffer);
+    glDeleteTextures(1, &gSoftwareTexture);
 
     // Release texture
     UDestroyTexture(gTextureId);
@@ -312,16 +658,82 @@ int main(int argc, char* argv[])
     UDestroyShaderProgram(gProgramId);
     UDestroyShaderProgram(gLampProgramId);
 
+    // Release uniform buffers and light storage
+    UDestroyUniformBuffers();
+    gLightClusters.destroy();
+
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 
 
+// Parses the command-line options
+// Usage: [--headless] [--size WIDTHxHEIGHT] [--frames N] [--output PREFIX] [--context egl|osmesa] [--software] [--texture PATH]
+bool UParseArguments(int argc, char* argv[], LaunchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool parsed = true;
+        if (strcmp(arg, "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(arg, "--size") == 0 && value)
+        {
+            parsed = sscanf(value, "%dx%d", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0;
+            i++;
+        }
+        else if (strcmp(arg, "--frames") == 0 && value)
+        {
+            options.frames = atoi(value);
+            parsed = options.frames > 0;
+            i++;
+        }
+        else if (strcmp(arg, "--output") == 0 && value)
+        {
+            options.outputPrefix = value;
+            i++;
+        }
+        else if (strcmp(arg, "--context") == 0 && value)
+        {
+            parsed = strcmp(value, "egl") == 0 || strcmp(value, "osmesa") == 0;
+            options.osmesa = strcmp(value, "osmesa") == 0;
+            i++;
+        }
+        else if (strcmp(arg, "--software") == 0)
+            options.software = true;
+        else if (strcmp(arg, "--texture") == 0 && value)
+        {
+            options.texturePath = value;
+            i++;
+        }
+        else
+            parsed = false;
+
+        if (!parsed)
+        {
+            cout << "Usage: " << argv[0] << " [--headless] [--size WIDTHxHEIGHT] [--frames N] [--output PREFIX] [--context egl|osmesa] [--software] [--texture PATH]" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
     // GLFW: initialize and configure
     // ------------------------------
-    glfwInit();
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+    // The null platform needs no display server, so headless runs work on GPU-less servers
+    if (gOptions.headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit())
+    {
+        std::cout << "Failed to initialize GLFW" << std::endl;
+        return false;
+    }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -330,9 +742,17 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    // Headless: a hidden window that only carries the context, which Mesa's llvmpipe
+    // provides through surfaceless EGL or OSMesa; frames go to an offscreen target
+    if (gOptions.headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, gOptions.osmesa ? GLFW_OSMESA_CONTEXT_API : GLFW_EGL_CONTEXT_API);
+    }
+
     // GLFW: window creation
     // ---------------------
-    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    * window = glfwCreateWindow(gOptions.width, gOptions.height, WINDOW_TITLE, NULL, NULL);
     if (*window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -346,13 +766,20 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
 
     // tell GLFW to capture our mouse
-    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!gOptions.headless)
+        glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // GLEW: initialize
     // ----------------
     // Note: if using GLEW version 1.13 or earlier
     glewExperimental = GL_TRUE;
     GLenum GlewInitResult = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // A GLX build of GLEW loads the GL entry points first and only then looks for an X
+    // display, which surfaceless EGL does not have. This error means the first part worked.
+    if (gOptions.headless && GlewInitResult == GLEW_ERROR_NO_GLX_DISPLAY)
+        GlewInitResult = GLEW_OK;
+#endif
 
     if (GLEW_OK != GlewInitResult)
     {
@@ -397,6 +824,48 @@ void UProcessInput(GLFWwindow* window)
         }
     }
 
+    // Toggle the per-frame statistics readout
+    static bool isFKeyDown = false;
+    bool fKeyPressed = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (fKeyPressed && !isFKeyDown)
+        gShowFrameStats = !gShowFrameStats;
+    isFKeyDown = fKeyPressed;
+
+    // Toggle the field of point lights
+    static bool isOKeyDown = false;
+    bool oKeyPressed = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (oKeyPressed && !isOKeyDown)
+        gShowLightField = !gShowLightField;
+    isOKeyDown = oKeyPressed;
+
+    // Toggle the crowd of instanced mugs
+    static bool isMKeyDown = false;
+    bool mKeyPressed = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (mKeyPressed && !isMKeyDown)
+        gShowMugCrowd = !gShowMugCrowd;
+    isMKeyDown = mKeyPressed;
+
+    // Toggle meshlet culling
+    static bool isCKeyDown = false;
+    bool cKeyPressed = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (cKeyPressed && !isCKeyDown)
+        gMeshletCulling = !gMeshletCulling;
+    isCKeyDown = cKeyPressed;
+
+    // Toggle occlusion culling
+    static bool isHKeyDown = false;
+    bool hKeyPressed = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (hKeyPressed && !isHKeyDown)
+        gOcclusionCulling = !gOcclusionCulling;
+    isHKeyDown = hKeyPressed;
+
+    // Toggle multi-draw indirect submission
+    static bool isIKeyDown = false;
+    bool iKeyPressed = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    if (iKeyPressed && !isIKeyDown)
+        gMultiDrawIndirect = !gMultiDrawIndirect;
+    isIKeyDown = iKeyPressed;
+
     // Pause and resume lamp orbiting
     static bool isLKeyDown = false;
     if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !gIsLampOrbiting)
@@ -410,6 +879,8 @@ void UProcessInput(GLFWwindow* window)
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    gViewportWidth = width;
+    gViewportHeight = height;
 }
 
 
@@ -516,685 +987,443 @@ void URender()
     // Creates a perspective/ortho projection
     glm::mat4 projection;
     if (ortho) {
-        projection = glm::ortho(-2.15f, 2.15f, -2.15f, 2.15f, 0.1f, 100.0f);
+        projection = glm::ortho(-ORTHO_HALF_SIZE, ORTHO_HALF_SIZE, -ORTHO_HALF_SIZE, ORTHO_HALF_SIZE, NEAR_PLANE, FAR_PLANE);
     }
     else {
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)gViewportWidth / (GLfloat)gViewportHeight, NEAR_PLANE, FAR_PLANE);
     }
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
+    // Every object's model matrix for the frame; the crowd sits in the table's model space so
+    // the mugs stand on the plane
+    glm::mat4 lampModels[] = {
+        glm::translate(gLightPosition) * glm::scale(gLightScale),
+        glm::translate(gFillLightPosition) * glm::scale(gFillLightScale),
+    };
+    glm::mat4 sphereModel = glm::mat4(1.0f);
+    sphereModel = glm::translate(sphereModel, glm::vec3(0.3f, 0.239f, 0.0f));
+    sphereModel = glm::scale(sphereModel, glm::vec3(0.13f)); // Make it a smaller sphere
+    gCrowdModels.clear();
+    if (gShowMugCrowd)
+    {
+        for (int row = 0; row < MUG_CROWD_ROWS; row++)
+        {
+            for (int col = 0; col < MUG_CROWD_COLUMNS; col++)
+            {
+                glm::vec3 offset(-6.5f + 9.0f * col / (MUG_CROWD_COLUMNS - 1), 0.0f, -0.75f + 5.5f * row / (MUG_CROWD_ROWS - 1));
+                gCrowdModels.push_back(model * glm::translate(offset) * glm::scale(glm::vec3(0.08f)));
+            }
+        }
+    }
 
-    // References the fill light position and attributes
-    GLint fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    GLint fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
+    // Bounding spheres of every object against the view frustum in one batch
+    gCullBounds.resize(CULL_CROWD + gCrowdModels.size());
+    gCullBounds[CULL_SCENE] = transformBounds(gMesh.sceneBounds, model);
+    gCullBounds[CULL_KEY_LAMP] = transformBounds(gMesh.lampBounds, lampModels[0]);
+    gCullBounds[CULL_FILL_LAMP] = transformBounds(gMesh.lampBounds, lampModels[1]);
+    gCullBounds[CULL_SPHERE] = transformBounds(gMesh.sphereBounds, sphereModel);
+    for (size_t i = 0; i < gCrowdModels.size(); i++)
+        gCullBounds[CULL_CROWD + i] = transformBounds(gMesh.mugBounds, gCrowdModels[i]);
+    gCullSpheres.resize(gCullBounds.size());
+    for (size_t i = 0; i < gCullBounds.size(); i++)
+        gCullSpheres[i] = glm::vec4(gCullBounds[i].center, gCullBounds[i].radius);
+    gCullVisible.resize(gCullSpheres.size());
+    cullSpheres(extractFrustum(projection * view), gCullSpheres.data(), gCullSpheres.size(), gCullVisible.data());
+
+    // Boxes that survived are tested against the occluders' depth; the scene holds the
+    // occluders itself, so it is never tested
+    if (gOcclusionCulling)
+    {
+        gOcclusion.rasterize(projection * view * model);
+        gOcclusion.cullBoxes(projection * view, &gCullBounds[CULL_KEY_LAMP], gCullBounds.size() - CULL_KEY_LAMP, &gCullVisible[CULL_KEY_LAMP]);
+    }
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    // Gather every visible instance of the frame so all transforms reach the GPU in one upload
+    gInstanceBuffer.clear();
+    bool sceneVisible = gCullVisible[CULL_SCENE] != 0;
+    bool sphereVisible = gCullVisible[CULL_SPHERE] != 0;
+    GLuint sceneInstance = sceneVisible ? gInstanceBuffer.add(model, gMesh.positionDecode) : 0;
+
+    // Each crowd mug takes the coarsest LOD that stays within LOD_MAX_PIXEL_ERROR, and each LOD
+    // gets a contiguous slice of instances
+    gCrowdLods.resize(gMesh.mugLods.size());
+    for (CrowdLodBatch& batch : gCrowdLods)
+        batch.models.clear();
+    for (size_t i = 0; i < gCrowdModels.size(); i++)
+    {
+        if (!gCullVisible[CULL_CROWD + i])
+            continue;
+        int lod = selectLod(gMesh.mugLods, ULodPixelsPerUnit(gCrowdModels[i]), LOD_MAX_PIXEL_ERROR);
+        gCrowdLods[lod].models.push_back(gCrowdModels[i]);
+    }
+    for (CrowdLodBatch& batch : gCrowdLods)
+    {
+        batch.firstInstance = gInstanceBuffer.size();
+        for (const glm::mat4& mugModel : batch.models)
+            gInstanceBuffer.add(mugModel, gMesh.positionDecode);
+    }
 
-    // Pass the fill light data to the shader uniform
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
+    // Both lamps share one instanced draw
+    GLuint lampInstance = gInstanceBuffer.size();
+    GLuint lampCount = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        if (!gCullVisible[CULL_KEY_LAMP + i])
+            continue;
+        gInstanceBuffer.add(lampModels[i], gMesh.positionDecode);
+        lampCount++;
+    }
 
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    GLuint sphereInstance = sphereVisible ? gInstanceBuffer.add(sphereModel, gMesh.spherePositionDecode) : 0;
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao);
+    // The software backend draws the same visible objects and LODs on the CPU
+    if (gOptions.software)
+    {
+        URenderSoftware(view, projection, model, sphereModel, lampModels, sceneVisible, sphereVisible);
+        return;
+    }
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, gMesh.nIndices, GL_UNSIGNED_SHORT, NULL); // Draws the triangle
+    gInstanceBuffer.upload(projection * view);
 
-    // LAMP: draw lamp
-    //----------------
-    glUseProgram(gLampProgramId);
+    // One command per heap draw: the scene and sphere when their meshlets are not culled, a
+    // command per crowd LOD, and both lamps in a run of their own for the lamp program
+    gIndirectDraws.clear();
+    GLuint phongRun = gIndirectDraws.beginRun();
+    if (sceneVisible && !gMeshletCulling)
+        gIndirectDraws.add(gMesh.scene, 0, gMesh.nIndices, 1, sceneInstance);
+    for (size_t lod = 0; lod < gCrowdLods.size(); lod++)
+    {
+        const MeshLod& range = gMesh.mugLods[lod];
+        gIndirectDraws.add(gMesh.scene, range.firstIndex, range.indexCount, (GLuint)gCrowdLods[lod].models.size(), gCrowdLods[lod].firstInstance);
+    }
+    if (sphereVisible && !gMeshletCulling)
+        gIndirectDraws.add(gMesh.sphere, 0, gMesh.sphere.indexCount, 1, sphereInstance);
+    GLuint lampRun = gIndirectDraws.beginRun();
+    gIndirectDraws.add(gMesh.scene, 0, gMesh.nLightIndices, lampCount, lampInstance);
+    if (gMultiDrawIndirect)
+        gIndirectDraws.upload();
+
+    // Only meshlets inside the frustum, and for the sphere facing the camera, reach the stream index buffers
+    GLuint sceneVisibleIndices = 0;
+    GLuint sphereVisibleIndices = 0;
+    if (gMeshletCulling && sceneVisible)
+        sceneVisibleIndices = gSceneMeshlets.cull(projection * view * model, UModelSpaceEye(model));
+    if (gMeshletCulling && sphereVisible)
+        sphereVisibleIndices = gSphereMeshlets.cull(projection * view * sphereModel, UModelSpaceEye(sphereModel));
+
+    // Camera, view position and both lights go to the shared uniform blocks in two uploads
+    UUpdateUniformBuffers(view, projection);
+
+    // Passes object data to the Shader program
+    gPhongProgram.set(gPhongUniforms.objectColor, gObjectColor);
+    gPhongProgram.set(gPhongUniforms.uvScale, gUVScale);
+
+    // Queue every draw with the state it needs. Meshlets that survived culling come from the
+    // cullers' stream index buffers, everything else from the heap's runs of indirect commands.
+    gRenderQueue.clear();
+    if (sceneVisible && gMeshletCulling)
+    {
+        float sceneDepth = -(view * glm::vec4(gCullBounds[CULL_SCENE].center, 1.0f)).z / FAR_PLANE;
+        gRenderQueue.add(makeSortKey(RENDER_PASS_OPAQUE, gProgramId, gTextureId, gMesh.culledVAO, sceneDepth),
+            makeElementsItem(gProgramId, gTextureId, gMesh.culledVAO, gSceneMeshlets.streamIndexType(), sceneVisibleIndices, NULL, 1,
+                gMesh.scene.baseVertex, sceneInstance));
+    }
+    if (sphereVisible && gMeshletCulling)
+    {
+        float sphereDepth = -(view * glm::vec4(gCullBounds[CULL_SPHERE].center, 1.0f)).z / FAR_PLANE;
+        gRenderQueue.add(makeSortKey(RENDER_PASS_OPAQUE, gProgramId, gTextureId, gMesh.sphereCulledVAO, sphereDepth),
+            makeElementsItem(gProgramId, gTextureId, gMesh.sphereCulledVAO, gSphereMeshlets.streamIndexType(), sphereVisibleIndices, NULL, 1,
+                gMesh.sphere.baseVertex, sphereInstance));
+    }
+    if (gIndirectDraws.runCommandCount(phongRun) > 0)
+        gRenderQueue.add(makeSortKey(RENDER_PASS_OPAQUE, gProgramId, gTextureId, gGeometry.vao(), 0.0f),
+            makeIndirectItem(gProgramId, gTextureId, gGeometry.vao(), gGeometry.indexType(), gIndirectDraws, phongRun, gMultiDrawIndirect));
+    // Lamps are unlit and untextured
+    if (gIndirectDraws.runCommandCount(lampRun) > 0)
+        gRenderQueue.add(makeSortKey(RENDER_PASS_OPAQUE, gLampProgramId, 0, gGeometry.vao(), 0.0f),
+            makeIndirectItem(gLampProgramId, 0, gGeometry.vao(), gGeometry.indexType(), gIndirectDraws, lampRun, gMultiDrawIndirect));
+    gRenderQueue.sort();
+    gRenderQueue.submit();
 
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
+    // Deactivate the Vertex Array Object & Shader program
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+// Implements the UCreateMesh function; false if the meshes could not be put on the GPU
+bool UCreateMesh(GLMesh& mesh)
+{
+    // Meshes come straight from their cache files when those were written for the same
+    // generator inputs and MESH_GENERATOR_VERSION; otherwise they are generated and cached for
+    // the next launch
+    SceneMeshSource sceneSource = USceneMeshSource();
+    uint64_t sceneKey = meshCacheKey("scene", &sceneSource, sizeof(sceneSource));
+    uint64_t sphereKey = meshCacheKey("icosphere", &SPHERE_SUBDIVISIONS, sizeof(SPHERE_SUBDIVISIONS));
+
+    // Generated meshes share one arena, released as a whole once they are on the GPU
+    MeshArena arena;
+    MeshCacheFile sceneCache;
+    ShapeData scene;
+    std::vector<MeshPart> sceneParts;
+    // Vertices go to the GPU packed, 16 bytes instead of 44. Cached meshes hold them ready to
+    // upload from the mapping; generated ones are packed here first.
+    const PackedVertex* scenePacked;
+    QuantizationBounds sceneQuantization;
+    std::vector<PackedVertex> scenePackedStorage;
+    bool sceneCached = sceneCache.open(SCENE_CACHE_PATH, sceneKey) && sceneCache.partCount() == SCENE_PART_COUNT && sceneCache.lodCount() > 0;
+    if (sceneCached)
+    {
+        scene = sceneCache.shape().view();
+        scenePacked = sceneCache.packedVertices();
+        sceneQuantization = sceneCache.quantization();
+        mesh.mugLods.assign(sceneCache.lods(), sceneCache.lods() + sceneCache.lodCount());
+        sceneParts.assign(sceneCache.parts(), sceneCache.parts() + sceneCache.partCount());
+        cout << "INFO: Scene mesh mapped from " << SCENE_CACHE_PATH << endl;
+    }
+    else
+    {
+        UBuildSceneMesh(sceneSource, scene, mesh.mugLods, sceneParts, arena);
+        sceneQuantization = computeQuantizationBounds(scene.vertices, scene.numVertices);
+        scenePackedStorage.resize(scene.numVertices);
+        packVertices(scene.vertices, scene.numVertices, sceneQuantization, scenePackedStorage.data());
+        scenePacked = scenePackedStorage.data();
+        if (!writeMeshCache(SCENE_CACHE_PATH, sceneKey, scene, scenePacked, sceneQuantization, mesh.mugLods, sceneParts))
+            cout << "WARNING: Could not write " << SCENE_CACHE_PATH << endl;
+    }
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, gMesh.nLightIndices, GL_UNSIGNED_SHORT, NULL); // Draws the triangle
+    // The LODs follow the scene's own indices
+    const MeshPart& cylinderPart = sceneParts[SCENE_PART_CYLINDER];
+    GLuint sceneIndexCount = cylinderPart.firstIndex + cylinderPart.indexCount;
+    gSceneMeshlets.build(scene, 0, sceneIndexCount, false);
+
+    // Bounds for frustum culling
+    mesh.sceneBounds = scene.bounds;
+    mesh.mugBounds = sceneParts[SCENE_PART_MUG].bounds;
+    mesh.lampBounds = sceneParts[SCENE_PART_LAMP].bounds;
+
+    // The mug and cylinder are the occluders; the plane is left out since nothing is drawn under it
+    const MeshPart& mugPart = sceneParts[SCENE_PART_MUG];
+    gOcclusion.addOccluder(scene, mugPart.firstIndex, mugPart.indexCount, glm::mat4(1.0f));
+    gOcclusion.addOccluder(scene, cylinderPart.firstIndex, cylinderPart.indexCount, glm::mat4(1.0f));
+
+    MeshCacheFile sphereCache;
+    ShapeData sphere;
+    const PackedVertex* spherePacked;
+    QuantizationBounds sphereQuantization;
+    std::vector<PackedVertex> spherePackedStorage;
+    bool sphereCached = sphereCache.open(SPHERE_CACHE_PATH, sphereKey);
+    if (sphereCached)
+    {
+        sphere = sphereCache.shape().view();
+        spherePacked = sphereCache.packedVertices();
+        sphereQuantization = sphereCache.quantization();
+        cout << "INFO: Sphere mesh mapped from " << SPHERE_CACHE_PATH << endl;
+    }
+    else
+    {
+        UBuildSphereMesh(sphere, arena);
+        sphereQuantization = computeQuantizationBounds(sphere.vertices, sphere.numVertices);
+        spherePackedStorage.resize(sphere.numVertices);
+        packVertices(sphere.vertices, sphere.numVertices, sphereQuantization, spherePackedStorage.data());
+        spherePacked = spherePackedStorage.data();
+        if (!writeMeshCache(SPHERE_CACHE_PATH, sphereKey, sphere, spherePacked, sphereQuantization, std::vector<MeshLod>(), std::vector<MeshPart>()))
+            cout << "WARNING: Could not write " << SPHERE_CACHE_PATH << endl;
+    }
+    gSphereMeshlets.build(sphere, 0, sphere.numIndices, true);
+    mesh.sphereBounds = sphere.bounds;
+
+    // Both meshes are sub-allocated from one heap, which takes 32-bit indices as soon as either
+    // mesh needs them
+    GLenum heapIndexType = scene.indexType == GL_UNSIGNED_INT || sphere.indexType == GL_UNSIGNED_INT ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    gGeometry.create(GEOMETRY_HEAP_VERTICES, GEOMETRY_HEAP_INDICES, heapIndexType);
+    mesh.spherePositionDecode = sphereQuantization.decodeMatrix();
+    if (!gGeometry.upload(spherePacked, sphere, mesh.sphere))
+    {
+        cout << "ERROR: The sphere does not fit in the geometry heap" << endl;
+        return false;
+    }
+    mesh.positionDecode = sceneQuantization.decodeMatrix();
+    if (!gGeometry.upload(scenePacked, scene, mesh.scene))
+    {
+        cout << "ERROR: The scene does not fit in the geometry heap" << endl;
+        return false;
+    }
 
-    // LAMP: draw fill lamp
-    //---------------------
-    glUseProgram(gLampProgramId);
+    // The software backend keeps float copies, since the cache mappings go away on return
+    if (gOptions.software)
+    {
+        gSoftwareScene = gSoftware.addMesh(scene);
+        gSoftwareSphere = gSoftware.addMesh(sphere);
+    }
 
-    model = glm::translate(gFillLightPosition) * glm::scale(gFillLightScale);
+    // Lamps draw the mug's base cap, which is the first fan of the index list
+    mesh.nLightIndices = sceneParts[SCENE_PART_LAMP].indexCount;
+    mesh.nIndices = sceneIndexCount;
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
+    // VAOs over the heap's vertices for the culled index streams; the cullers attach their element buffers
+    glGenVertexArrays(1, &mesh.culledVAO);
+    glBindVertexArray(mesh.culledVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, gGeometry.vertexBuffer());
+    setupPackedVertexAttributes();
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    glGenVertexArrays(1, &mesh.sphereCulledVAO);
+    glBindVertexArray(mesh.sphereCulledVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, gGeometry.vertexBuffer());
+    setupPackedVertexAttributes();
+    glBindVertexArray(0);
 
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, gMesh.nLightIndices, GL_UNSIGNED_SHORT, NULL); // Draws the triangle
+    // The GPU holds its own copy now; the arena and cache mappings are released on return
+    return true;
+}
 
-    // setup to draw sphere
-    glUseProgram(gProgramId);
-    glBindVertexArray(gMesh.sphereVAO);
-    model = model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.3f, 0.239f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.13f)); // Make it a smaller sphere
-    // lightingShader.setMat4("model", model);
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-    // draw sphere
-    glDrawElements(GL_TRIANGLES, sphereNumIndices, GL_UNSIGNED_SHORT, (void*)sphereIndexByteOffset);
+// Everything the scene mesh is generated from; see SceneMeshSource
+SceneMeshSource USceneMeshSource()
+{
+    /* MUG PROPORTIONS FOLLOW THE GEOGEBRA SKETCH.
+     * LINK: https://www.geogebra.org/3d/uqdn8zdx
+     */
+    SceneMeshSource source;
+    memset(&source, 0, sizeof(source));
+    source.resolution = MESH_RESOLUTION;
+    source.planeDimensions = 2;
+    // Mug body is an open-topped cylinder
+    source.bodyRadius = 1.0f;
+    source.bodyHeight = 2.0f;
+    source.bodyCaps[0] = GL_TRUE;
+    source.bodyCaps[1] = GL_FALSE;
+    // Handle is half a torus, placed against the body on +X
+    source.handleMajorRadius = 0.62f;
+    source.handleMinorRadius = 0.1f;
+    source.handleSweep = glm::radians(180.0f);
+    source.cylinderRadius = 0.75f;
+    source.cylinderHeight = 1.5f;
+    source.cylinderCaps[0] = GL_TRUE;
+    source.cylinderCaps[1] = GL_TRUE;
+
+    // Each part samples its own cell of the texture atlas: white mug, wooden table, black cylinder
+    const glm::vec2 uvCells[4][2] = {
+        { glm::vec2(0.001f, 0.001f), glm::vec2(0.249f, 0.249f) },
+        { glm::vec2(0.001f, 0.001f), glm::vec2(0.249f, 0.249f) },
+        { glm::vec2(0.001f, 0.251f), glm::vec2(0.249f, 0.499f) },
+        { glm::vec2(0.251f, 0.001f), glm::vec2(0.499f, 0.249f) },
+    };
+    memcpy(source.uvCells, uvCells, sizeof(uvCells));
 
+    source.placements[0] = glm::mat4(1.0f);
+    source.placements[1] = glm::translate(glm::vec3(0.98f, 1.0f, 0.0f)) * glm::rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    // makePlane(2) spans [-1, 0] on X and Z; stretched over x [-7, 3], z [-1.25, 5] just below the mug
+    source.placements[2] = glm::translate(glm::vec3(3.0f, -0.001f, 5.0f)) * glm::scale(glm::vec3(10.0f, 1.0f, 6.25f));
+    source.placements[3] = glm::translate(glm::vec3(-4.0f, 0.0f, 0.0f));
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE);
-    glBindTexture(GL_TEXTURE_2D, gTextureId);
+    memcpy(source.lodRatios, MUG_LOD_RATIOS, sizeof(MUG_LOD_RATIOS));
+    return source;
+}
 
 
+// Generates the combined scene mesh, its part table and the crowd mug LODs
+void UBuildSceneMesh(const SceneMeshSource& source, ShapeData& scene, std::vector<MeshLod>& mugLods, std::vector<MeshPart>& parts, MeshArena& arena)
+{
+    ShapeData shapes[] = {
+        // The body's base cap leads the index list so the lamps can reuse it as a disc
+        ShapeGenerator::makeCylinder(source.resolution, source.bodyRadius, source.bodyHeight, source.bodyCaps[0] != 0, source.bodyCaps[1] != 0, &arena),
+        ShapeGenerator::makeTorus(source.resolution / 2, source.resolution / 4, source.handleMajorRadius, source.handleMinorRadius, source.handleSweep, &arena),
+        ShapeGenerator::makePlane(source.planeDimensions, &arena),
+        ShapeGenerator::makeCylinder(source.resolution, source.cylinderRadius, source.cylinderHeight, source.cylinderCaps[0] != 0, source.cylinderCaps[1] != 0, &arena),
+    };
+    const int shapeCount = sizeof(shapes) / sizeof(shapes[0]);
+    ShapeData& body = shapes[0];
+    ShapeData& handle = shapes[1];
+    ShapeData& plane = shapes[2];
+    ShapeData& cylinder = shapes[3];
+
+    for (int i = 0; i < shapeCount; i++)
+        ShapeGenerator::fitUVs(shapes[i], source.uvCells[i][0], source.uvCells[i][1]);
+    const glm::mat4* placements = source.placements;
+    scene = ShapeGenerator::combine(shapes, placements, shapeCount, &arena);
+
+    // Draw ranges stay intact: lamp disc, rest of the mug, plane, cylinder
+    GLuint lampIndexCount = source.resolution * 3;
+    GLuint mugIndexCount = body.numIndices + handle.numIndices;
+    GLuint sceneDrawRanges[] = { lampIndexCount, mugIndexCount, mugIndexCount + plane.numIndices, scene.numIndices };
+    UOptimizeMesh(scene, "Scene mesh", sceneDrawRanges, 4);
+
+    // The lamp disc is the body's base cap, so the body's box holds it
+    parts.resize(SCENE_PART_COUNT);
+    parts[SCENE_PART_LAMP] = { 0, lampIndexCount, transformBounds(body.bounds, placements[0]) };
+    parts[SCENE_PART_MUG] = { 0, mugIndexCount, mergeBounds(transformBounds(body.bounds, placements[0]), transformBounds(handle.bounds, placements[1])) };
+    parts[SCENE_PART_PLANE] = { mugIndexCount, plane.numIndices, transformBounds(plane.bounds, placements[2]) };
+    parts[SCENE_PART_CYLINDER] = { mugIndexCount + plane.numIndices, cylinder.numIndices, transformBounds(cylinder.bounds, placements[3]) };
+
+    // Crowd mugs switch to coarser index ranges appended after the scene's own indices
+    mugLods = buildLodChain(scene, 0, mugIndexCount, source.lodRatios, sizeof(source.lodRatios) / sizeof(source.lodRatios[0]));
+    for (size_t i = 1; i < mugLods.size(); i++)
+    {
+        const MeshLod& lod = mugLods[i];
+        optimizeVertexCache(scene, lod.firstIndex, lod.indexCount);
+        cout << "INFO: Mug LOD " << i << ": " << lod.indexCount / 3 << " triangles, error " << lod.error << endl;
+    }
+}
 
-    // Deactivate the Vertex Array Object & Shader program
-    glBindVertexArray(0);
-    glUseProgram(0);
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+// Generates the sphere mesh
+void UBuildSphereMesh(ShapeData& sphere, MeshArena& arena)
+{
+    sphere = ShapeGenerator::makeIcosphere(SPHERE_SUBDIVISIONS, &arena);
+    GLuint sphereDrawRange = sphere.numIndices;
+    UOptimizeMesh(sphere, "Sphere mesh", &sphereDrawRange, 1);
 }
 
 
-// Implements the UCreateMesh function
-void UCreateMesh(GLMesh& mesh)
+// Reorders each draw range for the post-transform cache, then the vertices for fetch, and logs the gain
+void UOptimizeMesh(ShapeData& shape, const char* name, const GLuint* drawRangeEnds, int drawRangeCount)
 {
-    /* MUG DRAWN USING GEOGEBRA.
-     * USE LINK FOR REFERENCE TO POINTS DUE TO COMPLEXITY.
-     * LINK: https://www.geogebra.org/3d/uqdn8zdx
-     */
-
+    VertexCacheStats before = analyzeVertexCache(shape);
 
-     // Position and Texture data
-    GLfloat verts[] = {
-        // Vertex Positions         //Normal Coords                 // Texture Coords
-
-        /* MUG BASE */
-
-        // Index 0
-        0.0f, 0.0f, 0.0f,           0.125f, 0.0f,  0.0f,          0.25f, 0.001f, // A
-        // Index 1
-        1.0f, 0.0f, 0.0f,           0.016f, 0.0f, 0.0f,           0.03125f, 0.001f, // B
-        // Index 2
-        0.92f, 0.0f, 0.38f,         0.031f, 0.0f, 0.25f,          0.0625f, 0.001f, // C
-        // Index 3
-        0.71f, 0.0f, 0.71f,         0.047f, 0.0f, 0.5f,           0.09375f, 0.001f, // D
-        // Index 4
-        0.38f, 0.0f, 0.92f,         0.063f, 0.0f, 0.75f,          0.125f, 0.001f, // E
-        // Index 5
-        0.0f, 0.0f, 1.0f,           0.078f, 0.0f, 1.0f,           0.15625f, 0.001f, // F
-        // Index 6
-        -0.38f, 0.0f, 0.92f,        0.094f, 0.0f, 0.75f,          0.1875f, 0.001f, // G
-        // Index 7
-        -0.71f, 0.0f, 0.71f,        0.109f, 0.0f, 0.5f,           0.21875f, 0.001f, // H
-        // Index 8
-        -0.92f, 0.0f, 0.38f,        0.125f, 0.0f, 0.25f,          0.25f, 0.001f, // I
-        // Index 9
-        -1.0f, 0.0f, 0.0f,          0.141f, 0.0f, 0.0f,           0.28125f, 0.001f, // J
-        // Index 10
-        -0.92f, 0.0f, -0.38f,       0.156f, 0.0f, -0.25f,         0.3125f, 0.001f, // K
-        // Index 11
-        -0.71f, 0.0f, -0.71f,       0.172f, 0.0f, -0.5f,          0.34375f, 0.001f, // L
-        // Index 12
-        -0.38f, 0.0f, -0.92f,       0.188f, 0.0f, -0.75f,         0.375f, 0.001f, // M
-        // Index 13
-        0.0f, 0.0f, -1.0f,          0.203f, 0.0f, -1.0f,          0.40625f, 0.001f, // N
-        // Index 14
-        0.38f, 0.0f, -0.92f,        0.219f, 0.0f, -0.75f,         0.4375f, 0.001f, // O
-        //Index 15
-        0.71f, 0.0f, -0.71f,        0.234f, 0.0f, -0.5f,          0.46875, 0.001f, // P
-        // Index 16
-        0.92f, 0.0f, -0.38f,        0.249f, 0.0f, -0.25f,         0.5f, 0.001f, // Q
-
-        /* MUG TOP */
-
-        // Index 17
-        0.0f, 2.0f, 0.0f,           0.125f, 0.249f, 0.0f,         0.25f, 0.499f, // A1
-        // Index 18
-        1.0f, 2.0f, 0.0f,           0.016f, 0.249f, 0.0f,         0.3125f, 0.499f, // B1
-        // Index 19
-        0.92f, 2.0f, 0.38f,         0.031f, 0.249f, 0.25f,        0.0625f, 0.499f, // C1
-        // Index 20
-        0.71f, 2.0f, 0.71f,         0.047f, 0.249f, 0.5f,         0.09375f, 0.499f, // D1
-        // Index 21
-        0.38f, 2.0f, 0.92f,         0.063f, 0.249f, 0.75f,        0.125f, 0.499f, // E1
-        // Index 22
-        0.0f, 2.0f, 1.0f,           0.078f, 0.249f, 1.0f,         0.15625f, 0.499f, // F1
-        // Index 23
-        -0.38f, 2.0f, 0.92f,        0.094f, 0.249f, 0.75f,        0.1875f, 0.499f, // G1
-        // Index 24
-        -0.71f, 2.0f, 0.71f,        0.109f, 0.249f, 0.5f,         0.21875f, 0.499f, // H1
-        // Index 25
-        -0.92f, 2.0f, 0.38f,        0.125f, 0.249f, 0.25f,        0.25f, 0.499f, // I1
-        // Index 26
-        -1.0f, 2.0f, 0.0f,          0.141f, 0.249f, 0.0f,         0.28125f, 0.499f, // J1
-        // Index 27
-        -0.92f, 2.0f, -0.38f,       0.156f, 0.249f, -0.25f,       0.3125f, 0.499f, // K1
-        // Index 28
-        -0.71f, 2.0f, -0.71f,       0.172f, 0.249f, -0.5f,        0.34375f, 0.499f, // L1
-        // Index 29
-        -0.38f, 2.0f, -0.92f,       0.188f, 0.249f, -0.75f,       0.375f, 0.499f, // M1
-        // Index 30
-        0.0f, 2.0f, -1.0f,          0.203f, 0.249f, -1.0f,        0.40625f, 0.499f, // N1
-        // Index 31
-        0.38f, 2.0f, -0.92f,        0.219f, 0.249f, -0.75f,       0.4375f, 0.499f, // O1
-        //Index 32
-        0.71f, 2.0f, -0.71f,        0.234f, 0.249f, -0.5f,        0.46875, 0.499f, // P1
-        // Index 33
-        0.92f, 2.0f, -0.38f,        0.249f, 0.249f, -0.25f,       0.5f, 0.499f, // Q1
-
-        /* TORUS FRONT (BIG) */
-
-        // Index 34
-        1.0001f, 1.65f, 0.11f,      0.0f, 0.249f, 1.0f,           0.001, 0.499f, // R1
-        // Index 35
-        1.26f, 1.67f, 0.11f,        0.063f, 0.219f, 1.0f,         0.125f, 0.4375f, // R2
-        // Index 36
-        1.58f, 1.53f, 0.11f,        0.125f, 0.188f, 1.0f,         0.25f, 0.375f, // R3
-        // Index 37
-        1.82f, 1.24f, 0.11f,        0.188f, 0.156f, 1.0f,         0.375f, 0.3125f, // R4
-        // Index 38
-        1.86f, 1.0f, 0.11f,         0.249f, 0.125f, 1.0f,         0.499f, 0.25f, // R5
-        // Index 39
-        1.82f, 0.76f, 0.11f,        0.188f, 0.094f, 1.0f,         0.375f, 0.1875f, // R6
-        // Index 40
-        1.58f, 0.47f, 0.11f,        0.125f, 0.063f, 1.0f,         0.25f, 0.125f, // R7
-        // Index 41
-        1.26f, 0.33f, 0.11f,        0.063f, 0.031f, 1.0f,         0.125f, 0.0625f, // R8
-        // Index 42
-        1.0001f, 0.35f, 0.11f,      0.0f, 0.0f, 1.0f,             0.001f, 0.001f, // R9
-
-        /* TORUS FRONT (SMALL) */
-
-        // Index 43
-        0.99f, 1.475f,0.11f,        0.0f, 0.234f, 1.0f,           0.001f, 0.46875f, // S1
-        // Index 44
-        1.19f, 1.51f, 0.11f,        0.063f, 0.203f, 1.0f,         0.125f, 0.40625f, // S2
-        // Index 45
-        1.47f, 1.4f, 0.11f,         0.125f, 0.172f, 1.0f,         0.25f, 0.34375f, // S3
-        // Index 46
-        1.66f, 1.17f, 0.11f,        0.188f, 0.148f, 1.0f,         0.375f, 0.29688f, // S4
-        // Index 47
-        1.695f, 1.0f, 0.11f,        0.249f, 0.125f, 1.0f,         0.499f, 0.25f, // S5
-        // Index 48
-        1.66f, 0.83f, 0.11f,        0.188f, 0.109f, 1.0f,         0.375f, 0.21875f, // S6
-        // Index 49
-        1.47f, 0.6f, 0.11f,         0.125f, 0.078f, 1.0f,         0.25f, 0.15625f, // S7
-        // Index 50
-        1.19f, 0.49f, 0.11f,        0.063f, 0.047f, 1.0f,         0.125f, 0.09375f, // S8
-        // Index 51
-        0.99f, 0.525f,0.11f,        0.0f, 0.016f, 1.0f,           0.001f, 0.03125f, // S9
-
-        /* TORUS BACK (BIG) */
-
-        // Index 52
-        0.99f, 1.65f, -0.11f,       0.0f, 0.249f, -1.0f,          0.001, 0.5f, // T1
-        // Index 53
-        1.26f, 1.67f, -0.11f,       0.063, 0.219f, -1.0f,         0.125f, 0.4375f, // T2 (or TII according to graph issues...)
-        // Index 54
-        1.58f, 1.53f, -0.11f,       0.125f, 0.188f, -1.0f,        0.25f, 0.375f, // T3
-        // Index 55
-        1.82f, 1.24f, -0.11f,       0.188f, 0.156f, -1.0f,        0.375f, 0.3125f, // T4
-        // Index 56
-        1.86f, 1.0f, -0.11f,        0.249f, 0.125f, -1.0f,        0.499f, 0.25f, // T5
-        // Index 57
-        1.82f, 0.76f, -0.11f,       0.188f, 0.094f, -1.0f,        0.375f, 0.1875f, // T6
-        // Index 58
-        1.58f, 0.47f, -0.11f,       0.125f, 0.063f, -1.0f,        0.25f, 0.125f, // T7
-        // Index 59
-        1.26f, 0.33f, -0.11f,       0.063f, 0.031f, -1.0f,        0.125f, 0.0625f, // T8
-        // Index 60
-        0.99f, 0.35f, -0.11f,       0.0f, 0.0f, -1.0f,            0.001f, 0.0f, // T9
-
-        /* TORUS BACK (SMALL) */
-
-        // Index 61
-        0.99f, 1.475f, -0.11f,      0.0f, 0.234f, -1.0f,          0.001, 0.46875f, // U1
-        // Index 62
-        1.19f, 1.51f, -0.11f,       0.063f, 0.203f, -1.0f,        0.125f, 0.40625f, // U2
-        // Index 63
-        1.47f, 1.4f, -0.11f,        0.125f, 0.172f, -1.0f,        0.25f, 0.34375f, // U3
-        // Index 64
-        1.66f, 1.17f, -0.11f,       0.188f, 0.148f, -1.0f,        0.375f, 0.29688f, // U4
-        // Index 65
-        1.695f, 1.0f, -0.11f,       0.249f, 0.125f, -1.0f,        0.5f, 0.25f, // U5 or UV according to graph issues
-        // Index 66
-        1.66f, 0.83f, -0.11f,       0.188f, 0.109f, -1.0f,        0.375f, 0.21875f, // U6
-        // Index 67
-        1.47f, 0.6f, -0.11f,        0.125f, 0.078f, -1.0f,        0.25f, 0.15625f, // U7
-        // Index 68
-        1.19f, 0.49f, -0.11f,       0.063f, 0.047f, -1.0f,        0.125f, 0.09375f, // U8
-        // Index 69
-        0.99f, 0.525f, -0.11f,      0.0f, 0.016f, -1.0f,          0.001f, 0.03125f,  // U9
-
-        /* PLANE */
-
-        //Index 70
-        3.0f, -0.001f, 5.0f,        0.25f, 0.25f, 0.25f,          0.5f, 0.5f, // Lower right
-        //Index 71
-        3.0f, -0.001f, -1.25f,      0.25f, 0.498f, -0.5f,         0.5f, 0.999f, // Top right
-        // Index 72
-        -7.0f, -0.001f, 5.0f,       0.001f, 0.25f, 0.25f,         0.001f, 0.5f, // Lower left
-        // Index 73
-        -7.0f, -0.001f, -1.25f,     0.001f, 0.498f, -0.5f,        0.001f, 0.999f,  // Top left
-
-        /* CYLINDER BASE */
-
-        // Index 74
-        -4.0f, 0.0f, 0.0f,          0.375f, 0.1f,  0.0f,          0.75f, 0.001f, // A
-        // Index 75
-        -3.25f, 0.0f, 0.0f,         0.266f, 0.1f, 0.0f,           0.53125f, 0.001f, // B
-        // Index 76
-        -3.31f, 0.0f, 0.285f,       0.281f, 0.1f, 0.25f,          0.5625f, 0.001f, // C
-        // Index 77
-        -3.468f, 0.0f, 0.533f,      0.297f, 0.1f, 0.5f,           0.59375f, 0.001f, // D
-        // Index 78
-        -3.715f, 0.0f, 0.69f,       0.313f, 0.1f, 0.75f,          0.625f, 0.001f, // E
-        // Index 79
-        -4.0f, 0.0f, 0.75f,         0.328f, 0.1f, 1.0f,           0.65625f, 0.001f, // F
-        // Index 80
-        -4.285f, 0.0f, 0.69f,       0.344f, 0.1f, 0.75f,          0.6875f, 0.001f, // G
-        // Index 81
-        -4.533f, 0.0f, 0.533f,      0.359f, 0.1f, 0.5f,           0.71875f, 0.001f, // H
-        // Index 82
-        -4.69f, 0.0f, 0.285f,       0.375f, 0.1f, 0.25f,          0.75f, 0.001f, // I
-        // Index 83
-        -4.75f, 0.0f, 0.0f,         0.391f, 0.1f, 0.0f,           0.78125f, 0.001f, // J
-        // Index 84
-        -4.69f, 0.0f, -0.285f,      0.406f, 0.1f, -0.25f,         0.8125f, 0.001f, // K
-        // Index 85
-        -4.533f, 0.0f, -0.533f,     0.422f, 0.1f, -0.5f,          0.84375f, 0.001f, // L
-        // Index 86
-        -4.285f, 0.0f, -0.69f,      0.438f, 0.1f, -0.75f,         0.875f, 0.001f, // M
-        // Index 87
-        -4.0f, 0.0f, -0.75f,        0.453f, 0.1f, -1.0f,          0.90625f, 0.001f, // N
-        // Index 88
-        -3.715f, 0.0f, -0.69f,      0.469f, 0.1f, -0.75f,         0.9375f, 0.001f, // O
-        //Index 89
-        -3.468f, 0.0f, -0.533f,     0.484f, 0.1f, -0.5f,          0.96875, 0.001f, // P
-        // Index 90
-        -3.31f, 0.0f, -0.285f,      0.499f, 0.1f, -0.25f,         0.999f, 0.001f, // Q
-
-        /* CYLINDER TOP */
-
-        // Index 91
-        -4.0f, 1.5f, 0.0f,          0.375f, 0.249f, 0.0f,         0.75f, 0.499f, // A1
-        // Index 92
-        -3.25f, 1.5f, 0.0f,         0.266f, 0.249f, 0.0f,         0.53125f, 0.499f, // B1
-        // Index 93
-        -3.31f, 1.5f, 0.285f,       0.281f, 0.249f, 0.25f,        0.5625f, 0.499f, // C1
-        // Index 94
-        -3.468f, 1.5f, 0.533f,      0.297f, 0.249f, 0.5f,         0.59375f, 0.499f, // D1
-        // Index 95
-        -3.715f, 1.5f, 0.69f,       0.313f, 0.249f, 0.75f,        0.625f, 0.499f, // E1
-        // Index 96
-        -4.0f, 1.5f, 0.75f,         0.328f, 0.249f, 1.0f,         0.65625f, 0.499f, // F1
-        // Index 97
-        -4.285f, 1.5f, 0.69f,       0.344f, 0.249f, 0.75f,        0.6875f, 0.499f, // G1
-        // Index 98
-        -4.533f, 1.5f, 0.533f,      0.359f, 0.249f, 0.5f,         0.71875f, 0.499f, // H1
-        // Index 99
-        -4.69f, 1.5f, 0.285f,       0.375f, 0.249f, 0.25f,        0.75f, 0.499f, // I1
-        // Index 100
-        -4.75f, 1.5f, 0.0f,         0.391f, 0.249f, 0.0f,         0.78125f, 0.499f, // J1
-        // Index 101
-        -4.69f, 1.5f, -0.285f,      0.406f, 0.249f, -0.25f,       0.8125f, 0.499f, // K1
-        // Index 102
-        -4.533f, 1.5f, -0.533f,     0.422f, 0.249f, -0.5f,        0.84375f, 0.499f, // L1
-        // Index 103
-        -4.285f, 1.5f, -0.69f,      0.438f, 0.249f, -0.75f,       0.875f, 0.499f, // M1
-        // Index 104
-        -4.0f, 1.5f, -0.75f,        0.453f, 0.249f, -1.0f,        0.90625f, 0.499f, // N1
-        // Index 105
-        -3.715f, 1.5f, -0.69f,      0.469f, 0.249f, -0.75f,       0.9375f, 0.499f, // O1
-        //Index 106
-        -3.468f, 1.5f, -0.533f,     0.484f, 0.249f, -0.5f,        0.96875, 0.499f, // P1
-        // Index 107
-        -3.31f, 1.5f, -0.285f,      0.499f, 0.249f, -0.25f,       0.999f, 0.499f, // Q1
+    GLuint first = 0;
+    for (int i = 0; i < drawRangeCount; i++)
+    {
+        optimizeVertexCache(shape, first, drawRangeEnds[i] - first);
+        first = drawRangeEnds[i];
+    }
+    optimizeVertexFetch(shape);
 
-    };
+    VertexCacheStats after = analyzeVertexCache(shape);
+    cout << "INFO: " << name << " ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+}
 
-    // Index data to share position data
-    GLushort indices[] = {
-        /* MUG BASE */
-
-        0, 1, 2,    // ABC
-        0, 2, 3,    // ACD
-        0, 3, 4,    // ADE
-        0, 4, 5,    // AEF
-        0, 5, 6,    // AFG
-        0, 6, 7,    // AGH
-        0, 7, 8,    // AHI
-        0, 8, 9,    // AIJ
-        0, 9, 10,   // AJK
-        0, 10, 11,  // AKL
-        0, 11, 12,  // ALM
-        0, 12, 13,  // AMN
-        0, 13, 14,  // ANO
-        0, 14, 15,  // AOP
-        0, 15, 16,  // APQ
-        0, 1, 16,   // ABQ
-
-        /* MUG BODY */
-
-        1, 2, 18,   // BCB1
-        2, 18, 19,  // CB1C1
-        2, 3, 19,   // CDC1
-        3, 19, 20,  // DC1D1
-        3, 4, 20,   // DED1
-        4, 20, 21,  // ED1E1
-        4, 5, 21,   // EFE1
-        5, 21, 22,  // FE1F1
-        5, 6, 22,   // FGF1
-        6, 22, 23,  // GF1G1
-        6, 7, 23,   // GHG1
-        7, 23, 24,  // HG1H1
-        7, 8, 24,   // HIH1
-        8, 24, 25,  // IH1I1
-        8, 9, 25,   // IJI1
-        9, 25, 26,  // JI1J1
-        9, 10, 26,  // JKJ1
-        10, 26, 27, // KJ1K1
-        10, 11, 27, // KLK1
-        11, 27, 28, // LK1L1
-        11, 12, 28, // LML1
-        12, 28, 29, // ML1M1
-        12, 13, 29, // MNM1
-        13, 29, 30, // NM1N1
-        13, 14, 30, // NON1
-        14, 30, 31, // ON1O1
-        14, 15, 31, // OPO1
-        15, 31, 32, // PO1P1
-        15, 16, 32, // PQP1
-        16, 32, 33, // QP1Q1
-        16, 1, 33,  // QBQ1
-        1, 18, 33,  // BB1Q1
-
-        /* OUTER TORUS */
-
-        34, 35, 52, // R1R2T1
-        35, 52, 53, // R2T1T2 
-        35, 36, 53, // R2R3T2
-        36, 53, 54, // R3T2T3
-        36, 37, 54, // R3R4T3
-        37, 54, 55, // R4T3T4
-        37, 38, 55, // R4R5T4
-        38, 55, 56, // R5T4T5
-        38, 39, 56, // R5R6T5
-        39, 56, 57, // R6T5T6
-        39, 40, 57, // R6R7T6
-        40, 57, 58, // R7T6T7
-        40, 41, 58, // R7R8T7
-        41, 58, 59, // R8T7T8
-        41, 42, 59, // R8R9T8
-        42, 59, 60, // R9T8T9
-
-        /* FRONT SIDE TORUS */
-
-        34, 35, 43, // R1R2S1
-        35, 43, 44, // R2S1S2
-        35, 36, 44, // R2R3S2
-        36, 44, 45, // R3S2S3
-        36, 37, 45, // R3R4S3
-        37, 45, 46, // R4S3S4
-        37, 38, 46, // R4R5S4
-        38, 46, 47, // R5S4S5
-        38, 39, 47, // R5R6S5
-        39, 47, 48, // R6S5S6
-        39, 40, 48, // R6R7S6
-        40, 48, 49, // R7S6S7
-        40, 41, 49, // R7R8S7
-        41, 49, 50, // R8S7S8
-        41, 42, 50, // R8R9S8
-        42, 50, 51, // R9S8S9
-
-
-        /* BACK SIDE TORUS */
-
-        52, 53, 61, // T1T2U1
-        53, 61, 62, // T2U1U2
-        53, 54, 62, // T2T3U2
-        54, 62, 63, // T3U2U3
-        54, 55, 63, // T3T4U3
-        55, 63, 64, // T4U3U4
-        55, 56, 64, // T4T5U4
-        56, 64, 65, // T5U4U5
-        56, 57, 65, // T5T6U5
-        57, 65, 66, // T6U5U6
-        57, 58, 66, // T6T7U6
-        58, 66, 67, // T7U6U7
-        58, 59, 67, // T7T8U7
-        59, 67, 68, // T8U7U8
-        59, 60, 68, // T8T9U8
-        60, 68, 69, // T9U8U9
-
-        /* INNER TORUS */
-
-        43, 44, 61, // S1S2U1
-        44, 61, 62, // S2U1U2
-        44, 45, 62, // S2S3U2
-        45, 62, 63, // S3U2U3
-        45, 46, 63, // S3S4U3
-        46, 63, 64, // S4U3U4
-        46, 47, 64, // S4S5U4
-        47, 64, 65, // S5U4U5
-        47, 48, 65, // S5S6U5
-        48, 65, 66, // S6U5U6
-        48, 49, 66, // S6S7U6
-        49, 66, 67, // S7U6U7
-        49, 50, 67, // S7S8U7
-        50, 67, 68, // S8U7U8
-        50, 51, 68, // S8S9U8
-        51, 68, 69, // S9U8U9
-
-        /* INSIDE HANDLE TORUS */
-
-        34, 43, 52, // R1S1T1
-        43, 52, 61, // S1T1U1
-        42, 51, 60, // R9S9T9
-        51, 60, 69, // S9T9U9
-
-        /* PLANE */
-
-        70, 71, 72, // Lower right of Plane
-        71, 72, 73, // Top left of Plane
-
-        /* CYLINDER BASE*/
-
-        74, 75, 76,    // ABC
-        74, 76, 77,    // ACD
-        74, 77, 78,    // ADE
-        74, 78, 79,    // AEF
-        74, 79, 80,    // AFG
-        74, 80, 81,    // AGH
-        74, 81, 82,    // AHI
-        74, 82, 83,    // AIJ
-        74, 83, 84,    // AJK
-        74, 84, 85,    // AKL
-        74, 85, 86,    // ALM
-        74, 86, 87,    // AMN
-        74, 87, 88,    // ANO
-        74, 88, 89,    // AOP
-        74, 89, 90,    // APQ
-        74, 75, 90,    // ABQ
-
-        /* CYLINDER TOP */
-
-        91, 92, 93,   // A1B1C1
-        91, 93, 94,   // A1C1D1
-        91, 94, 95,   // A1D1E1
-        91, 95, 96,   // A1E1F1
-        91, 96, 97,   // A1F1G1
-        91, 97, 98,   // A1G1H1
-        91, 98, 99,   // A1H1I1
-        91, 99, 100,  // A1I1J1
-        91, 100, 101, // A1J1K1
-        91, 101, 102, // A1K1L1
-        91, 102, 103, // A1L1M1
-        91, 103, 104, // A1M1N1
-        91, 104, 105, // A1N1O1
-        91, 105, 106, // A1O1P1
-        91, 106, 107, // A1P1Q1
-        91, 92, 107,  // A1B1Q1 
-
-        /* CYLINDER BODY */
-
-        75, 76, 92,   // BCB1
-        76, 92, 93,   // CB1C1
-        76, 77, 93,   // CDC1
-        77, 93, 94,   // DC1D1
-        77, 78, 94,   // DED1
-        78, 94, 95,   // ED1E1
-        78, 79, 95,   // EFE1
-        79, 95, 96,   // FE1F1
-        79, 80, 96,   // FGF1
-        80, 96, 97,   // GF1G1
-        80, 81, 97,   // GHG1
-        81, 97, 98,   // HG1H1
-        81, 82, 98,   // HIH1
-        82, 98, 99,   // IH1I1
-        82, 83, 99,   // IJI1
-        83, 99, 100,  // JI1J1
-        83, 84, 100,  // JKJ1
-        84, 100, 101, // KJ1K1
-        84, 85, 101,  // KLK1
-        85, 101, 102, // LK1L1
-        85, 86, 102,  // LML1
-        86, 102, 103, // ML1M1
-        86, 87, 103,  // MNM1
-        87, 103, 104, // NM1N1
-        87, 88, 104,  // NON1
-        88, 104, 105, // ON1O1
-        88, 89, 105,  // OPO1
-        89, 105, 106, // PO1P1
-        89, 90, 106,  // PQP1
-        90, 106, 107, // QP1Q1
-        90, 75, 107,  // QBQ1
-        75, 92, 107,  // BB1Q1
 
-    };
+// Pixels covered by one mesh space unit of an object drawn with this model matrix
+float ULodPixelsPerUnit(const glm::mat4& model)
+{
+    float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    if (ortho)
+        return scale * gViewportHeight / (2.0f * ORTHO_HALF_SIZE);
 
-    GLuint lightIndices[] =
-    {
-        /* HEXADECAGON CIRCLE */
-
-        17, 18, 19, // A1B1C1
-        17, 19, 20, // A1C1D1
-        17, 20, 21, // A1D1E1
-        17, 21, 22, // A1E1F1
-        17, 22, 23, // A1F1G1
-        17, 23, 24, // A1G1H1
-        17, 24, 25, // A1H1I1
-        17, 25, 26, // A1I1J1
-        17, 26, 27, // A1J1K1
-        17, 27, 28, // A1K1L1
-        17, 28, 29, // A1L1M1
-        17, 29, 30, // A1M1N1
-        17, 30, 31, // A1N1O1
-        17, 31, 32, // A1O1P1
-        17, 32, 33, // A1P1Q1
-        17, 18, 33, // A1B1Q1       
-    };
+    float distance = glm::max(glm::length(glm::vec3(model[3]) - gCamera.Position), NEAR_PLANE);
+    return scale * gViewportHeight / (2.0f * tanf(glm::radians(gCamera.Zoom) * 0.5f) * distance);
+}
 
-    // Signifies the floats per coordinate system
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    // creates sphere object
-    ShapeData sphere = ShapeGenerator::makeSphere();
-
-    glGenVertexArrays(1, &mesh.sphereVAO);
-    glGenBuffers(1, &mesh.sphereVBO);
-    glBindVertexArray(mesh.sphereVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.sphereVBO);
-    glBufferData(GL_ARRAY_BUFFER, sphere.vertexBufferSize() + sphere.indexBufferSize(), 0, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTE_SIZE, (void*)0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTE_SIZE, (void*)(sizeof(float) * 3));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTE_SIZE, (void*)(sizeof(float) * 6));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.sphereVBO);
-
-    GLsizeiptr currentOffset = 0;
-    glBufferSubData(GL_ARRAY_BUFFER, currentOffset, sphere.vertexBufferSize(), sphere.vertices);
-    currentOffset += sphere.vertexBufferSize();
-    sphereIndexByteOffset = currentOffset;
-    glBufferSubData(GL_ARRAY_BUFFER, currentOffset, sphere.indexBufferSize(), sphere.indices);
-    sphereNumIndices = sphere.numIndices;
-
-    // Creates vao for holding the vbo containing vertex/indice data
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(2, mesh.vbos);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Creates lighting buffer
-    mesh.nLightIndices = sizeof(lightIndices) / sizeof(lightIndices[0]);
-    mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-    // Create Vertex Attribute Pointers for mesh data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
 
+// Camera position in an object's model space, for the meshlet back-face test. Orthographic
+// rays are parallel, which an eye pulled far back along the view direction approximates.
+glm::vec3 UModelSpaceEye(const glm::mat4& model)
+{
+    glm::vec3 eye = gCamera.Position;
+    if (ortho)
+        eye -= gCamera.Front * (FAR_PLANE * 100.0f);
+    return glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
 }
 
 
 void UDestroyMesh(GLMesh& mesh)
 {
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(1, mesh.vbos);
+    glDeleteVertexArrays(1, &mesh.culledVAO);
+    glDeleteVertexArrays(1, &mesh.sphereCulledVAO);
+    gGeometry.release(mesh.scene);
+    gGeometry.release(mesh.sphere);
+    gGeometry.destroy();
 }
 
 /*Generate and load the texture*/
@@ -1205,6 +1434,8 @@ bool UCreateTexture(const char* filename, GLuint& textureId)
     if (image)
     {
         flipImageVertically(image, width, height, channels);
+        if (gOptions.software && (channels == 3 || channels == 4))
+            gSoftware.setTexture(image, width, height, channels);
 
         glGenTextures(1, &textureId);
         glBindTexture(GL_TEXTURE_2D, textureId);
@@ -1243,69 +1474,221 @@ void UDestroyTexture(GLuint textureId)
     glGenTextures(1, &textureId);
 }
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+void UDestroyShaderProgram(GLuint programId)
+{
+    glDeleteProgram(programId);
+}
+
+
+// Reflects both shader programs and resolves the uniform handles used by URender
+void UReflectShaderPrograms()
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
-
-    // Create a Shader program object.
-    programId = glCreateProgram();
-
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
-
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    gPhongProgram.reflect(gProgramId);
+    gPhongUniforms.objectColor = gPhongProgram.handle("objectColor");
+    gPhongUniforms.uvScale = gPhongProgram.handle("uvScale");
+    gPhongUniforms.texture = gPhongProgram.handle("uTexture");
 
-        return false;
-    }
+    gLampProgram.reflect(gLampProgramId);
+}
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 
-        return false;
-    }
+// Creates the FrameData and LightData blocks at their fixed binding points
+void UCreateUniformBuffers()
+{
+    gFrameBuffer.create(FRAME_BLOCK_BINDING, sizeof(FrameUniforms));
+    gLightBuffer.create(LIGHT_BLOCK_BINDING, sizeof(LightUniforms));
+}
+
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+void UDestroyUniformBuffers()
+{
+    gFrameBuffer.destroy();
+    gLightBuffer.destroy();
+}
+
+
+// Packs the camera and lights into their std140 mirrors and uploads each block once
+void UUpdateUniformBuffers(const glm::mat4& view, const glm::mat4& projection)
+{
+    FrameUniforms frame = {};
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPosition = gCamera.Position;
+    gFrameBuffer.update(&frame);
+
+    UUpdateLights(view, projection);
+
+    LightUniforms lights = {};
+    lights.clusterGrid = glm::uvec4(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z, gLightClusters.globalLightCount());
+    lights.clusterDepth = glm::vec4(NEAR_PLANE, FAR_PLANE, gLightClusters.depthSliceScale(), gLightClusters.depthSliceBias());
+    lights.viewportSize = glm::vec2((float)gViewportWidth, (float)gViewportHeight);
+    gLightBuffer.update(&lights);
+}
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
+
+// Scatters small colored point lights just above the table
+void UCreateLightField()
+{
+    gLightField.clear();
+    for (int i = 0; i < LIGHT_FIELD_COUNT; i++)
     {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        PointLight light;
+        light.position = glm::vec3(-7.0f + 10.0f * (rand() / (float)RAND_MAX), 0.25f, -1.25f + 6.25f * (rand() / (float)RAND_MAX));
+        light.radius = 0.8f;
+        light.color = glm::vec3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+        light.ambientStrength = 0.0f;
+        gLightField.push_back(light);
+    }
+}
 
-        return false;
+
+// Rebuilds the scene light list and bins it into the cluster grid for this frame's camera
+void UUpdateLights(const glm::mat4& view, const glm::mat4& projection)
+{
+    gLights.clear();
+
+    // Key and fill lights keep their original unbounded Phong contribution
+    PointLight keyAndFill[2];
+    UKeyAndFillLights(keyAndFill);
+    gLights.push_back(keyAndFill[0]);
+    gLights.push_back(keyAndFill[1]);
+
+    if (gShowLightField)
+        gLights.insert(gLights.end(), gLightField.begin(), gLightField.end());
+
+    gLightClusters.build(gLights, view, projection, NEAR_PLANE, FAR_PLANE);
+    gLightClusters.upload(gLights);
+}
+
+
+// The key and fill lights, shared by the GL light list and the software backend
+void UKeyAndFillLights(PointLight lights[2])
+{
+    PointLight key = { gLightPosition, 0.0f, gLightColor, 0.2f };
+    PointLight fill = { gFillLightPosition, 0.0f, gFillLightColor, 0.2f };
+    lights[0] = key;
+    lights[1] = fill;
+}
+
+
+// Draws the frame's visible objects with the CPU rasterizer, then shows the result
+void URenderSoftware(const glm::mat4& view, const glm::mat4& projection, const glm::mat4& model, const glm::mat4& sphereModel,
+    const glm::mat4 lampModels[2], bool sceneVisible, bool sphereVisible)
+{
+    // Only the key and fill light: the light field needs the GL path's clusters
+    PointLight lights[2];
+    UKeyAndFillLights(lights);
+    gSoftware.beginFrame(gViewportWidth, gViewportHeight, view, projection, gCamera.Position, lights, 2, gUVScale,
+        glm::vec4(0.3f, 0.0f, 0.0f, 0.0f));
+
+    if (sceneVisible)
+        gSoftware.drawLit(gSoftwareScene, 0, gMesh.nIndices, model);
+    for (size_t lod = 0; lod < gCrowdLods.size(); lod++)
+    {
+        const MeshLod& range = gMesh.mugLods[lod];
+        for (const glm::mat4& mugModel : gCrowdLods[lod].models)
+            gSoftware.drawLit(gSoftwareScene, range.firstIndex, range.indexCount, mugModel);
+    }
+    if (sphereVisible)
+        gSoftware.drawLit(gSoftwareSphere, 0, gMesh.sphere.indexCount, sphereModel);
+    for (int i = 0; i < 2; i++)
+    {
+        if (gCullVisible[CULL_KEY_LAMP + i])
+            gSoftware.drawFlat(gSoftwareScene, 0, gMesh.nLightIndices, lampModels[i]);
     }
+    gSoftware.render();
 
-    glUseProgram(programId);    // Uses the shader program
+    UPresentSoftwareFrame();
+}
 
-    return true;
+
+// Uploads the software frame and blits it to the current draw framebuffer
+void UPresentSoftwareFrame()
+{
+    int width = gSoftware.width(), height = gSoftware.height();
+    if (!gSoftwareTexture || width != gSoftwareTextureWidth || height != gSoftwareTextureHeight)
+    {
+        if (!gSoftwareFramebuffer)
+        {
+            glGenTextures(1, &gSoftwareTexture);
+            glGenFramebuffers(1, &gSoftwareFramebuffer);
+        }
+        glBindTexture(GL_TEXTURE_2D, gSoftwareTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        gSoftwareTextureWidth = width;
+        gSoftwareTextureHeight = height;
+    }
+    else
+        glBindTexture(GL_TEXTURE_2D, gSoftwareTexture);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, gSoftware.stride());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, gSoftware.colorBuffer());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Frame capture reads from the read framebuffer, so it goes back to the draw target afterwards
+    GLint drawFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gSoftwareFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gSoftwareTexture, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+// Prints the uniform upload counters once per second while the readout is enabled
+void UReportFrameStats()
 {
-    glDeleteProgram(programId);
+    static float lastReport = 0.0f;
+    if (!gShowFrameStats || gLastFrame - lastReport < 1.0f)
+        return;
+    lastReport = gLastFrame;
+
+    const ShaderProgram::FrameStats& phong = gPhongProgram.frameStats();
+    const ShaderProgram::FrameStats& lamp = gLampProgram.frameStats();
+    cout << "Uniform uploads: " << phong.uploads + lamp.uploads
+        << " issued, " << phong.skipped + lamp.skipped << " skipped (cached), "
+        << gFrameBuffer.updateCount() + gLightBuffer.updateCount() << " block updates" << endl;
+    cout << "Lights: " << gLights.size() << " (" << gLightClusters.globalLightCount()
+        << " unbounded, " << gLightClusters.binnedReferences() << " cluster references)" << endl;
+    size_t visibleObjects = 0;
+    for (unsigned char visible : gCullVisible)
+        visibleObjects += visible;
+    cout << "Objects: " << visibleObjects << "/" << gCullVisible.size() << " inside the frustum" << endl;
+    if (gOcclusionCulling)
+    {
+        cout << "Occlusion: " << gOcclusion.culledCount() << " hidden behind " << gOcclusion.occluderTriangleCount()
+            << " occluder triangles, " << gOcclusion.passMilliseconds() << " ms" << endl;
+    }
+    if (gMeshletCulling)
+    {
+        cout << "Meshlets: scene " << gSceneMeshlets.visibleMeshletCount() << "/" << gSceneMeshlets.meshletCount()
+            << " (" << gSceneMeshlets.visibleTriangleCount() << "/" << gSceneMeshlets.triangleCount() << " triangles), sphere "
+            << gSphereMeshlets.visibleMeshletCount() << "/" << gSphereMeshlets.meshletCount()
+            << " (" << gSphereMeshlets.visibleTriangleCount() << "/" << gSphereMeshlets.triangleCount() << " triangles)" << endl;
+    }
+    const RenderQueue::BindStats& programBinds = gRenderQueue.programBinds();
+    const RenderQueue::BindStats& textureBinds = gRenderQueue.textureBinds();
+    const RenderQueue::BindStats& vaoBinds = gRenderQueue.vaoBinds();
+    cout << "State binds: " << programBinds.issued + textureBinds.issued + vaoBinds.issued << " issued, "
+        << programBinds.skipped + textureBinds.skipped + vaoBinds.skipped << " skipped over " << gRenderQueue.size()
+        << " queued draws (programs " << programBinds.issued << "/" << programBinds.skipped << ", textures "
+        << textureBinds.issued << "/" << textureBinds.skipped << ", VAOs " << vaoBinds.issued << "/" << vaoBinds.skipped << ")" << endl;
+    if (gOptions.software)
+    {
+        cout << "Software: " << gSoftware.rasterizedTriangles() << " triangles, vertices " << gSoftware.vertexMilliseconds()
+            << " ms, binning " << gSoftware.binMilliseconds() << " ms, raster " << gSoftware.rasterMilliseconds() << " ms" << endl;
+    }
+    cout << "Heap draws: " << gIndirectDraws.commandCount() << " commands in "
+        << (gMultiDrawIndirect ? gIndirectDraws.runCount() : gIndirectDraws.commandCount()) << " calls" << endl;
+    if (gShowMugCrowd)
+    {
+        cout << "Crowd mugs per LOD:";
+        for (const CrowdLodBatch& batch : gCrowdLods)
+            cout << " " << batch.models.size();
+        cout << endl;
+    }
 }